@@ -0,0 +1,394 @@
+/**
+ * @file colfile.c
+ * Binary column files. A column file starts with a short header and a
+ * description of each column (name, units, and data type), followed by the
+ * data for each column, stored contiguously and aligned. Loading one is just
+ * a matter of mapping it into memory and pointing the columns of a table at
+ * the right places, so nothing needs to be parsed or copied.
+ *
+ * These are also used to cache csv files. The first time a csv file is
+ * loaded with CSVLoadCached, the parsed values are saved next to it (as
+ * data.csv.col), along with the size and modification time of the csv file.
+ * After that, the cache is loaded instead as long as the csv file hasn't
+ * changed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "colfile.h"
+#include "csv.h"
+
+/**
+ * Round a file offset up to the column alignment.
+ */
+static uint64_t ColFileAlign(uint64_t n)
+{
+    return (n + COLALIGN-1)/COLALIGN*COLALIGN;
+}
+
+/**
+ * Copy a string into a fixed size field, cutting it off if it's too long.
+ * @param dst Field to copy to
+ * @param src String to copy
+ * @param len Number of characters to copy from src
+ * @param size Size of the field (including the terminator)
+ */
+static void ColFileCopyLabel(char *dst, char *src, size_t len, size_t size)
+{
+    if(len > size-1)
+        len = size-1;
+    memset(dst, 0, size);
+    memcpy(dst, src, len);
+}
+
+/**
+ * Split a csv header line into column names and units. Headers like
+ * "Time [s]" are split into the name "Time" and the unit "s".
+ * @param header Header line, or NULL if there isn't one
+ * @param c Column descriptions to fill in
+ * @param ncols Number of columns
+ */
+static void ColFileLabels(char *header, colfilecol *c, int ncols)
+{
+    char *p = header, *e, *u, *ue;
+    int j;
+
+    for(j=0; j<ncols && p; j++) {
+        e = p + strcspn(p, ",\r\n");
+        /* Trim off whitespace and quotes */
+        while(p < e && (*p == ' ' || *p == '"'))
+            p++;
+        while(e > p && (e[-1] == ' ' || e[-1] == '"'))
+            e--;
+
+        u = memchr(p, '[', e-p);
+        ue = u ? memchr(u, ']', e-u) : NULL;
+        if(u && ue) {
+            ColFileCopyLabel(c[j].unit, u+1, ue-u-1, COLUNITMAX);
+            while(u > p && u[-1] == ' ')
+                u--;
+            ColFileCopyLabel(c[j].name, p, u-p, COLNAMEMAX);
+        } else {
+            ColFileCopyLabel(c[j].name, p, e-p, COLNAMEMAX);
+        }
+
+        p = strchr(p, ',');
+        if(p)
+            p++;
+    }
+}
+
+/**
+ * Save a table to a column file, along with where it came from. The file is
+ * written under a temporary name and then renamed, so anyone loading it at
+ * the same time either gets the old file or the complete new one.
+ * @param file Name of the file to make
+ * @param t Table to save
+ * @param header csv header line to get column names from. If NULL, the
+ *      names in the table are used, if it has any.
+ * @param src Source csv file, or NULL
+ * @param skip Header lines skipped in the source
+ * @returns 0 on success
+ */
+static int ColFileWriteSource(char *file, csvtable *t, char *header,
+                              struct stat *src, int skip)
+{
+    colfilehdr h;
+    colfilecol *c;
+    char *tmp, pad[COLALIGN];
+    uint64_t pos;
+    size_t n;
+    int fd, j, status = 0;
+    FILE *fp;
+
+    memset(&h, 0, sizeof(colfilehdr));
+    memcpy(h.magic, COLFILEMAGIC, 8);
+    h.order = COLFILEORDER;
+    h.ncols = t->ncols;
+    h.nrows = t->nrows;
+    if(src) {
+        h.srcsize = src->st_size;
+        h.srcmtime = src->st_mtim.tv_sec;
+        h.srcmtimens = src->st_mtim.tv_nsec;
+        h.srcskip = skip;
+    }
+
+    c = (colfilecol*) calloc(sizeof(colfilecol), t->ncols ? t->ncols : 1);
+    if(header) {
+        ColFileLabels(header, c, t->ncols);
+    } else if(t->name) {
+        for(j=0; j<t->ncols; j++) {
+            ColFileCopyLabel(c[j].name, t->name[j], strlen(t->name[j]),
+                             COLNAMEMAX);
+            ColFileCopyLabel(c[j].unit, t->unit[j], strlen(t->unit[j]),
+                             COLUNITMAX);
+        }
+    }
+    pos = ColFileAlign(sizeof(colfilehdr) + t->ncols*sizeof(colfilecol));
+    for(j=0; j<t->ncols; j++) {
+        c[j].dtype = COLDOUBLE;
+        c[j].offset = pos;
+        pos = ColFileAlign(pos + sizeof(double)*t->nrows);
+    }
+
+    n = strlen(file);
+    tmp = (char*) calloc(sizeof(char), n+8);
+    sprintf(tmp, "%sXXXXXX", file);
+    fd = mkstemp(tmp);
+    if(fd < 0) {
+        free(tmp);
+        free(c);
+        return 1;
+    }
+    fchmod(fd, 0644);
+    fp = fdopen(fd, "w");
+    if(!fp) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        free(c);
+        return 1;
+    }
+
+    memset(pad, 0, COLALIGN);
+    pos = sizeof(colfilehdr) + t->ncols*sizeof(colfilecol);
+    fwrite(&h, sizeof(colfilehdr), 1, fp);
+    fwrite(c, sizeof(colfilecol), t->ncols, fp);
+    for(j=0; j<t->ncols; j++) {
+        fwrite(pad, 1, c[j].offset - pos, fp);
+        fwrite(t->col[j], sizeof(double), t->nrows, fp);
+        pos = c[j].offset + sizeof(double)*t->nrows;
+    }
+
+    status = ferror(fp);
+    status |= fclose(fp);
+    if(!status)
+        status = rename(tmp, file);
+    if(status)
+        unlink(tmp);
+
+    free(tmp);
+    free(c);
+
+    return status;
+}
+
+/**
+ * Save a table to a column file.
+ * @param file Name of the file to make
+ * @param t Table to save
+ * @param header csv header line to get column names and units from, such as
+ *      "Time [s],Moisture Content [kg/kg db]". If NULL, the names in the
+ *      table are used, if it has any.
+ * @returns 0 on success
+ */
+int ColFileWrite(char *file, csvtable *t, char *header)
+{
+    return ColFileWriteSource(file, t, header, NULL, 0);
+}
+
+/**
+ * Map a column file into memory. The columns of the table point straight
+ * into the file, and pages are only read in as they're used. The mapping is
+ * private, so the table can still be changed (with CSVDeleteNaNRows, for
+ * example) without touching the file.
+ * @param file Name of the file
+ * @returns Table of values, or NULL if the file can't be opened or isn't a
+ *      valid column file.
+ */
+csvtable* ColFileLoad(char *file)
+{
+    csvtable *t;
+    colfilehdr *h;
+    colfilecol *c;
+    struct stat st;
+    uint64_t size; /* Size of the file */
+    char *map;
+    int fd, j;
+
+    fd = open(file, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(colfilehdr)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return NULL;
+
+    /* Make sure this really is a column file that fits in a table. The sizes
+     * come from the file, so the checks are written so that they can't
+     * overflow. */
+    size = st.st_size;
+    h = (colfilehdr*) map;
+    c = (colfilecol*) (map + sizeof(colfilehdr));
+    if(memcmp(h->magic, COLFILEMAGIC, 8) || h->order != COLFILEORDER
+            || h->ncols > INT_MAX || h->nrows > INT_MAX
+            || h->ncols > (size - sizeof(colfilehdr))/sizeof(colfilecol)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    for(j=0; j<h->ncols; j++) {
+        if(c[j].dtype != COLDOUBLE || c[j].offset % sizeof(double)
+                || c[j].offset > size
+                || h->nrows > (size - c[j].offset)/sizeof(double)) {
+            munmap(map, st.st_size);
+            return NULL;
+        }
+    }
+
+    t = (csvtable*) calloc(sizeof(csvtable), 1);
+    t->nrows = h->nrows;
+    t->ncols = h->ncols;
+    t->map = map;
+    t->mapsize = st.st_size;
+    t->col = (double**) calloc(sizeof(double*), t->ncols ? t->ncols : 1);
+    t->name = (char**) calloc(sizeof(char*), t->ncols ? t->ncols : 1);
+    t->unit = (char**) calloc(sizeof(char*), t->ncols ? t->ncols : 1);
+    for(j=0; j<t->ncols; j++) {
+        c[j].name[COLNAMEMAX-1] = '\0';
+        c[j].unit[COLUNITMAX-1] = '\0';
+        t->col[j] = (double*) (map + c[j].offset);
+        t->name[j] = c[j].name;
+        t->unit[j] = c[j].unit;
+    }
+
+    return t;
+}
+
+/**
+ * Save a table as a csv file. If the table has column names, they're written
+ * as the header, with the units in brackets.
+ * @param t Table to save
+ * @param file Name of the csv file
+ * @param precision Significant digits, or 0 for the shortest round trip
+ * @returns 0 on success
+ */
+int ColFileToCSV(csvtable *t, char *file, int precision)
+{
+    csvwriter *w;
+    double *v;
+    int i, j;
+
+    w = CreateCSVWriter(file, precision, 1);
+    if(!w)
+        return 1;
+
+    if(t->name) {
+        for(j=0; j<t->ncols; j++) {
+            if(j)
+                CSVWriteString(w, ",");
+            CSVWriteString(w, t->name[j]);
+            if(t->unit[j][0]) {
+                CSVWriteString(w, " [");
+                CSVWriteString(w, t->unit[j]);
+                CSVWriteString(w, "]");
+            }
+        }
+        CSVWriteString(w, "\n");
+    }
+
+    v = (double*) calloc(sizeof(double), t->ncols ? t->ncols : 1);
+    for(i=0; i<t->nrows; i++) {
+        for(j=0; j<t->ncols; j++)
+            v[j] = csvval(t, i, j);
+        CSVWriteRow(w, v, t->ncols);
+    }
+    free(v);
+
+    return DestroyCSVWriter(w);
+}
+
+/**
+ * Get the last header line of a csv file.
+ * @param file Name of the csv file
+ * @param skip Number of header lines
+ * @returns Newly allocated copy of line number skip, or NULL if there isn't
+ *      one
+ */
+char* ColFileHeaderLine(char *file, int skip)
+{
+    char *line = NULL;
+    size_t n = 0;
+    int i;
+    FILE *fp;
+
+    if(skip < 1)
+        return NULL;
+    fp = fopen(file, "r");
+    if(!fp)
+        return NULL;
+    for(i=0; i<skip; i++) {
+        if(getline(&line, &n, fp) < 0) {
+            free(line);
+            line = NULL;
+            break;
+        }
+    }
+    fclose(fp);
+
+    return line;
+}
+
+/**
+ * Load a csv file, using the column file cache next to it if it's up to date.
+ * If there isn't a cache (or the csv file has changed since it was made), the
+ * csv file is parsed and a new cache is saved. The column names are taken
+ * from the last header line. If the cache can't be saved (because the
+ * directory is read only, for example), the values are still returned.
+ * Column files can also be loaded directly with this.
+ * @param file Name of the csv file
+ * @param skip Number of lines at the top of the file to ignore
+ * @returns Table of values, or NULL if the file can't be opened
+ */
+csvtable* CSVLoadCached(char *file, int skip)
+{
+    csvtable *t;
+    colfilehdr *h;
+    struct stat st;
+    char *cache, *header;
+
+    /* See if this is already a column file */
+    t = ColFileLoad(file);
+    if(t)
+        return t;
+
+    if(stat(file, &st) < 0)
+        return NULL;
+
+    cache = (char*) calloc(sizeof(char), strlen(file)+strlen(COLFILEEXT)+1);
+    sprintf(cache, "%s%s", file, COLFILEEXT);
+
+    t = ColFileLoad(cache);
+    if(t) {
+        h = (colfilehdr*) t->map;
+        if(h->srcsize == (uint64_t) st.st_size
+                && h->srcmtime == st.st_mtim.tv_sec
+                && h->srcmtimens == st.st_mtim.tv_nsec
+                && h->srcskip == skip) {
+            free(cache);
+            return t;
+        }
+        DestroyCSVTable(t);
+    }
+
+    t = CSVLoad(file, skip);
+    if(t) {
+        header = ColFileHeaderLine(file, skip);
+        ColFileWriteSource(cache, t, header, &st, skip);
+        free(header);
+    }
+    free(cache);
+
+    return t;
+}
+
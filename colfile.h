@@ -0,0 +1,51 @@
+#ifndef COLFILE_H
+#define COLFILE_H
+
+#include <stdint.h>
+#include "csv.h"
+
+#define COLFILEMAGIC "COLFILE1" /* First 8 bytes of every column file */
+#define COLFILEORDER 0x01020304 /* Used to check the byte order */
+#define COLFILEEXT ".col" /* Added to a csv file name to name its cache */
+#define COLNAMEMAX 48 /* Longest column name, including the terminator */
+#define COLUNITMAX 16 /* Longest unit, including the terminator */
+#define COLALIGN 64 /* Alignment of each column in the file [bytes] */
+
+#define COLDOUBLE 1 /* Column of 64-bit doubles */
+
+/**
+ * Header at the start of a column file. The source fields are only set when
+ * the file is a cache of a csv file, and are zero otherwise.
+ */
+typedef struct {
+    char magic[8]; /* COLFILEMAGIC */
+    uint32_t order, /* COLFILEORDER, as written by the machine that made it */
+             ncols; /* Number of columns */
+    uint64_t nrows; /* Number of rows */
+    uint64_t srcsize; /* Size of the source csv file [bytes] */
+    int64_t srcmtime, /* Modification time of the source [s] */
+            srcmtimens; /* Nanoseconds part of the modification time */
+    int32_t srcskip, /* Header lines skipped in the source */
+            reserved;
+} colfilehdr;
+
+/**
+ * Description of one column. These follow the header, one per column, and the
+ * data for each column starts at its offset, aligned to COLALIGN bytes.
+ */
+typedef struct {
+    char name[COLNAMEMAX]; /* Column name */
+    char unit[COLUNITMAX]; /* Units, or empty if there aren't any */
+    uint32_t dtype, /* Data type (COLDOUBLE) */
+             reserved;
+    uint64_t offset; /* Start of the data, from the start of the file [bytes] */
+} colfilecol;
+
+int ColFileWrite(char*, csvtable*, char*);
+csvtable* ColFileLoad(char*);
+int ColFileToCSV(csvtable*, char*, int);
+char* ColFileHeaderLine(char*, int);
+csvtable* CSVLoadCached(char*, int);
+
+#endif
+
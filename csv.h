@@ -0,0 +1,69 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "matrix.h"
+
+#define CSVFIELDMAX 32 /* Longest formatted number, including the terminator */
+
+/**
+ * Buffered csv file writer.
+ * @see CreateCSVWriter
+ */
+typedef struct {
+    FILE *fp; /* File being written */
+    int precision; /* Significant digits, or 0 for the shortest round trip */
+    char *buf[2]; /* Write buffers (the second is only used with a thread) */
+    size_t len[2], /* Number of bytes in each buffer waiting to be written */
+           pos; /* Number of bytes used in the current buffer */
+    int cur; /* Buffer being filled */
+
+    /* Background flush thread */
+    int threaded, /* Set if there is a flush thread */
+        pending, /* Buffer waiting to be written, or -1 */
+        done; /* Set when the thread should exit */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} csvwriter;
+
+/**
+ * Numbers loaded from a csv file, stored by column.
+ * @see CSVLoad
+ * @see ColFileLoad
+ */
+typedef struct {
+    int nrows, /* Number of rows */
+        ncols; /* Number of columns */
+    double **col; /* Values in each column. Empty fields are NaN. */
+    char **name, /* Name of each column, or NULL if they aren't known */
+         **unit; /* Units of each column, or NULL if they aren't known */
+    void *map; /* Mapped file the columns are stored in, or NULL */
+    size_t mapsize; /* Size of the mapped file */
+} csvtable;
+
+#define csvval(t, i, j) ((t)->col[(j)][(i)]) /* Value in row i, column j */
+
+int CSVFormatDouble(char*, double, int);
+
+csvwriter* CreateCSVWriter(char*, int, int);
+int DestroyCSVWriter(csvwriter*);
+void CSVFlush(csvwriter*);
+void CSVWriteBytes(csvwriter*, char*, size_t);
+void CSVWriteString(csvwriter*, char*);
+void CSVWriteRow(csvwriter*, double*, int);
+void CSVWriteVectors(csvwriter*, vector**, int, int*, int);
+void CSVWriteMatrix(csvwriter*, matrix*, int*, int);
+int csvprntfilehdr(matrix*, char*, char*, int);
+
+double CSVParseDouble(char*, char*);
+csvtable* CSVLoad(char*, int);
+void DestroyCSVTable(csvtable*);
+int CSVDeleteNaNRows(csvtable*, int*, int);
+vector* CSVColumnVector(csvtable*, int);
+matrix* CSVColumnMatrix(csvtable*, int);
+matrix* CSVTableMatrix(csvtable*, int*, int);
+
+#endif
+
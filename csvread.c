@@ -0,0 +1,402 @@
+/**
+ * @file csvread.c
+ * Fast loader for csv files full of numbers. The file is memory mapped and
+ * split into chunks at line breaks, and each chunk is parsed on its own
+ * thread straight into the columns of the table. Most numbers are converted
+ * exactly with one floating point multiply or divide (Clinger, "How to Read
+ * Floating Point Numbers Accurately", 1990), and anything else is handed to
+ * strtod.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "csv.h"
+#include "matrix.h"
+
+#define CSVCHUNKMIN (1<<20) /* Smallest chunk of a file worth its own thread [bytes] */
+#define CSVMAXDIGITS 19 /* Most significant digits that fit in 64 bits */
+
+/* Powers of ten that are exactly representable as doubles */
+static const double CSVPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ * Convert one field of a csv file to a double. The field doesn't need to be
+ * null terminated. If it has at most 15 or so significant digits and a small
+ * exponent, the digits and the power of ten are both exact doubles, so a
+ * single multiply or divide gives the correctly rounded result. Everything
+ * else (long mantissas, huge exponents, nan, inf) goes through strtod.
+ * @param s First character of the field
+ * @param end One past the last character of the field
+ * @returns Value of the field, or NaN if it's empty or not a number
+ */
+double CSVParseDouble(char *s, char *end)
+{
+    char buf[4*CSVFIELDMAX], *p, *e,
+         *str = buf; /* Null terminated copy of the field for strtod */
+    uint64_t w = 0; /* Significant digits */
+    int neg = 0, /* Set if the number is negative */
+        nd = 0, /* Number of significant digits */
+        digits = 0, /* Number of digits in the mantissa */
+        e10 = 0, /* Decimal exponent */
+        ex = 0, exneg = 0; /* Exponent written after the e */
+    double x;
+    size_t n;
+
+    /* Trim off any whitespace */
+    while(s < end && (*s == ' ' || *s == '\t'))
+        s++;
+    while(end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+    if(s == end)
+        return NAN;
+
+    p = s;
+    if(*p == '-' || *p == '+')
+        neg = (*p++ == '-');
+    for(; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        if(w || *p != '0')
+            nd++;
+        w = 10*w + (*p - '0');
+    }
+    if(p < end && *p == '.') {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, e10--) {
+            if(w || *p != '0')
+                nd++;
+            w = 10*w + (*p - '0');
+        }
+    }
+    if(digits == 0 || nd > CSVMAXDIGITS)
+        goto fallback;
+
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if(p < end && (*p == '-' || *p == '+'))
+            exneg = (*p++ == '-');
+        if(p == end || *p < '0' || *p > '9')
+            goto fallback;
+        for(; p < end && *p >= '0' && *p <= '9'; p++)
+            if(ex < 10000)
+                ex = 10*ex + (*p - '0');
+        e10 += exneg ? -ex : ex;
+    }
+    if(p != end)
+        goto fallback;
+
+    if(w == 0)
+        return neg ? -0.0 : 0.0;
+    if(w <= (UINT64_C(1) << 53) && e10 >= -22 && e10 <= 22) {
+        x = (double) w;
+        x = (e10 < 0) ? x/CSVPow10[-e10] : x*CSVPow10[e10];
+        return neg ? -x : x;
+    }
+
+fallback:
+    /* Long fields (like %f output of a huge number) get their own buffer, so
+     * they're never cut off and read as a different number */
+    n = end - s;
+    if(n >= sizeof(buf))
+        str = (char*) malloc(n+1);
+    if(!str)
+        return NAN;
+    memcpy(str, s, n);
+    str[n] = '\0';
+    x = strtod(str, &e);
+    if(e == str)
+        x = NAN;
+    if(str != buf)
+        free(str);
+
+    return x;
+}
+
+/**
+ * Find the start of the next line.
+ * @param p Somewhere in the current line
+ * @param end End of the file
+ * @returns Start of the next line, or end if this is the last one
+ */
+static char* CSVNextLine(char *p, char *end)
+{
+    char *q = memchr(p, '\n', end-p);
+    return q ? q+1 : end;
+}
+
+/**
+ * Check whether a line has nothing on it but whitespace.
+ */
+static int CSVBlankLine(char *p, char *end)
+{
+    for(; p < end; p++)
+        if(*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+            return 0;
+    return 1;
+}
+
+/**
+ * Count the rows and columns in a chunk of a file.
+ * @param p Start of the chunk (at the start of a line)
+ * @param end End of the chunk (at the start of a line)
+ * @param nrows Set to the number of lines that aren't blank
+ * @param ncols Set to the most fields on any one line
+ */
+static void CSVCountRows(char *p, char *end, int *nrows, int *ncols)
+{
+    char *le; /* Start of the next line */
+    int n;
+
+    *nrows = *ncols = 0;
+    for(; p < end; p = le) {
+        le = CSVNextLine(p, end);
+        if(CSVBlankLine(p, le))
+            continue;
+        (*nrows)++;
+        for(n=1; p < le; p++)
+            if(*p == ',')
+                n++;
+        if(n > *ncols)
+            *ncols = n;
+    }
+}
+
+/**
+ * Parse the rows in a chunk of a file into the table. Fields missing from the
+ * end of a line are set to NaN.
+ * @param t Table to store the values in
+ * @param p Start of the chunk (at the start of a line)
+ * @param end End of the chunk (at the start of a line)
+ * @param row Row of the table for the first line in the chunk
+ */
+static void CSVParseRows(csvtable *t, char *p, char *end, int row)
+{
+    char *le, /* Start of the next line */
+         *fe; /* End of the current field */
+    int j;
+
+    for(; p < end; p = le) {
+        le = CSVNextLine(p, end);
+        if(CSVBlankLine(p, le))
+            continue;
+        for(j=0; j<t->ncols; j++) {
+            if(p < le) {
+                fe = memchr(p, ',', le-p);
+                if(!fe)
+                    fe = (le[-1] == '\n') ? le-1 : le;
+                csvval(t, row, j) = CSVParseDouble(p, fe);
+                p = fe+1;
+            } else {
+                csvval(t, row, j) = NAN;
+            }
+        }
+        row++;
+    }
+}
+
+/**
+ * Load a csv file full of numbers. This takes the place of mtxloadcsv, but
+ * the values are stored by column, blank lines are skipped, and empty fields
+ * (or anything else that isn't a number) are set to NaN. Large files are
+ * parsed in parallel.
+ * @param file Name of the file
+ * @param skip Number of lines at the top of the file to ignore
+ * @returns Table of values, or NULL if the file can't be opened
+ */
+csvtable* CSVLoad(char *file, int skip)
+{
+    csvtable *t;
+    struct stat st;
+    char *map = NULL, /* Contents of the file */
+         *start, *end, /* Part of the file with data in it */
+         **b; /* Where each chunk starts */
+    int *nrows, *ncols, /* Rows and columns in each chunk */
+        *row0, /* First row of each chunk */
+        nchunks = 1, /* Number of chunks to split the file into */
+        fd, i, k;
+
+    fd = open(file, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if(st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    start = map;
+    end = map + st.st_size;
+    for(i=0; i<skip && start<end; i++)
+        start = CSVNextLine(start, end);
+
+    /* Split the file into chunks that each start at the beginning of a line */
+#ifdef _OPENMP
+    nchunks = 1 + (end-start)/CSVCHUNKMIN;
+    if(nchunks > omp_get_max_threads())
+        nchunks = omp_get_max_threads();
+#endif
+    b = (char**) calloc(sizeof(char*), nchunks+1);
+    nrows = (int*) calloc(sizeof(int), nchunks);
+    ncols = (int*) calloc(sizeof(int), nchunks);
+    row0 = (int*) calloc(sizeof(int), nchunks);
+    b[0] = start;
+    b[nchunks] = end;
+    for(k=1; k<nchunks; k++) {
+        b[k] = CSVNextLine(start + (end-start)/nchunks*k, end);
+        if(b[k] < b[k-1])
+            b[k] = b[k-1];
+    }
+
+    /* Count the rows in each chunk to find out where they go in the table */
+#pragma omp parallel for schedule(static)
+    for(k=0; k<nchunks; k++)
+        CSVCountRows(b[k], b[k+1], &nrows[k], &ncols[k]);
+
+    t = (csvtable*) calloc(sizeof(csvtable), 1);
+    for(k=0; k<nchunks; k++) {
+        row0[k] = t->nrows;
+        t->nrows += nrows[k];
+        if(ncols[k] > t->ncols)
+            t->ncols = ncols[k];
+    }
+    t->col = (double**) calloc(sizeof(double*), t->ncols ? t->ncols : 1);
+    for(i=0; i<t->ncols; i++)
+        t->col[i] = (double*) malloc(sizeof(double)*(t->nrows ? t->nrows : 1));
+
+#pragma omp parallel for schedule(static)
+    for(k=0; k<nchunks; k++)
+        CSVParseRows(t, b[k], b[k+1], row0[k]);
+
+    if(map)
+        munmap(map, st.st_size);
+    close(fd);
+    free(b);
+    free(nrows);
+    free(ncols);
+    free(row0);
+
+    return t;
+}
+
+/**
+ * Free a csv table.
+ * @param t Table to destroy
+ */
+void DestroyCSVTable(csvtable *t)
+{
+    int i;
+
+    /* Columns (and names) loaded from a binary file belong to the mapping */
+    if(t->map)
+        munmap(t->map, t->mapsize);
+    else
+        for(i=0; i<t->ncols; i++)
+            free(t->col[i]);
+    free(t->col);
+    free(t->name);
+    free(t->unit);
+    free(t);
+}
+
+/**
+ * Remove every row that has a NaN in any of the selected columns. Rows are
+ * moved up in place, so nothing is copied into a new table.
+ * @param t Table to remove rows from
+ * @param cols Columns to check. If NULL, all of them are checked.
+ * @param ncols Number of columns in cols
+ * @returns Number of rows left
+ */
+int CSVDeleteNaNRows(csvtable *t, int *cols, int ncols)
+{
+    int i, j, n = 0, keep;
+
+    if(!cols)
+        ncols = t->ncols;
+
+    for(i=0; i<t->nrows; i++) {
+        keep = 1;
+        for(j=0; j<ncols && keep; j++)
+            if(isnan(csvval(t, i, cols ? cols[j] : j)))
+                keep = 0;
+        if(!keep)
+            continue;
+        if(n != i)
+            for(j=0; j<t->ncols; j++)
+                csvval(t, n, j) = csvval(t, i, j);
+        n++;
+    }
+    t->nrows = n;
+
+    return n;
+}
+
+/**
+ * Copy one column of a table into a vector.
+ * @param t Table
+ * @param j Column number. Columns past the end of the table are all NaN.
+ * @returns Vector with one element per row
+ */
+vector* CSVColumnVector(csvtable *t, int j)
+{
+    vector *v;
+    int i;
+
+    v = CreateVector(t->nrows);
+    for(i=0; i<t->nrows; i++)
+        setvalV(v, i, (j < t->ncols) ? csvval(t, i, j) : NAN);
+
+    return v;
+}
+
+/**
+ * Copy one column of a table into a column matrix, in the same way as
+ * ExtractColumn.
+ * @param t Table
+ * @param j Column number. Columns past the end of the table are all NaN.
+ * @returns Matrix with one row per row of the table and one column
+ */
+matrix* CSVColumnMatrix(csvtable *t, int j)
+{
+    return CSVTableMatrix(t, &j, 1);
+}
+
+/**
+ * Copy a set of columns from a table into a matrix, such as the independent
+ * variables for fitnlmM.
+ * @param t Table
+ * @param cols Columns to copy, in order. Columns past the end of the table
+ *      are all NaN.
+ * @param ncols Number of columns in cols
+ * @returns Matrix with one row per row of the table
+ */
+matrix* CSVTableMatrix(csvtable *t, int *cols, int ncols)
+{
+    matrix *m;
+    int i, j;
+
+    m = CreateMatrix(t->nrows, ncols);
+    for(j=0; j<ncols; j++)
+        for(i=0; i<t->nrows; i++)
+            setval(m, (cols[j] < t->ncols) ? csvval(t, i, cols[j]) : NAN,
+                   i, j);
+
+    return m;
+}
+
@@ -0,0 +1,662 @@
+/**
+ * @file csvwrite.c
+ * Buffered csv writer. Numbers are formatted with the Grisu2 algorithm (Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ * 2010), which finds the shortest string that reads back as the same double
+ * using only 64-bit integer arithmetic. This is much faster than printf, and
+ * nothing is lost when the output is loaded again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "csv.h"
+#include "matrix.h"
+
+#define CSVBUFSIZE (1<<20) /* Size of each write buffer [bytes] */
+#define CSVMAXPRECISION 17 /* Most significant digits ever needed for a double */
+#define CSVGRISUPRECISION 15 /* Precisions from here up are left to printf */
+
+/**
+ * Floating point number with a 64-bit significand: f*2^e
+ */
+typedef struct {
+    uint64_t f;
+    int e;
+} diyfp;
+
+/* Normalized significands and binary exponents of 10^k, for
+ * k = -348, -340, ..., 340 */
+static const uint64_t CachedPowF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+static const int16_t CachedPowE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t Pow10[] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL,
+    100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL};
+
+/**
+ * Split a (positive, finite) double into significand and exponent.
+ * @param d Value to split
+ * @returns d as a diyfp
+ */
+static diyfp DiyFpDouble(double d)
+{
+    diyfp x;
+    uint64_t u;
+    int be;
+
+    memcpy(&u, &d, sizeof(double));
+    be = (int) ((u >> 52) & 0x7FF);
+    x.f = u & 0x000FFFFFFFFFFFFFULL;
+    if(be) {
+        x.f |= 0x0010000000000000ULL;
+        x.e = be - 1075;
+    } else {
+        x.e = -1074;
+    }
+
+    return x;
+}
+
+/**
+ * Multiply two diyfp numbers, keeping the (rounded) upper 64 bits.
+ */
+static diyfp DiyFpMul(diyfp x, diyfp y)
+{
+    diyfp r;
+    unsigned __int128 p = (unsigned __int128) x.f * y.f;
+
+    r.f = (uint64_t) (p >> 64) + (((uint64_t) p >> 63) & 1);
+    r.e = x.e + y.e + 64;
+
+    return r;
+}
+
+/**
+ * Shift a diyfp so that the top bit of the significand is set.
+ */
+static diyfp DiyFpNormalize(diyfp x)
+{
+    int s = __builtin_clzll(x.f);
+    x.f <<= s;
+    x.e -= s;
+    return x;
+}
+
+/**
+ * Find the boundaries halfway between v and its neighboring doubles. Any
+ * number between them reads back as v. Both have the same exponent as the
+ * normalized upper boundary.
+ * @param v Value (from DiyFpDouble)
+ * @param m Set to the lower boundary
+ * @param p Set to the upper boundary
+ */
+static void DiyFpBoundaries(diyfp v, diyfp *m, diyfp *p)
+{
+    p->f = (v.f << 1) + 1;
+    p->e = v.e - 1;
+    *p = DiyFpNormalize(*p);
+
+    /* The gap below a power of two is half as big */
+    if(v.f == 0x0010000000000000ULL) {
+        m->f = (v.f << 2) - 1;
+        m->e = v.e - 2;
+    } else {
+        m->f = (v.f << 1) - 1;
+        m->e = v.e - 1;
+    }
+    m->f <<= m->e - p->e;
+    m->e = p->e;
+}
+
+/**
+ * Find a cached power of ten that brings a number with binary exponent e into
+ * the range where the digits can be generated with 64-bit integers.
+ * @param e Binary exponent
+ * @param K Set to the decimal exponent of the cached power (negated)
+ * @returns Cached power of ten
+ */
+static diyfp CachedPower(int e, int *K)
+{
+    diyfp c;
+    double dk = (-61 - e)*0.30102999566398114 + 347;
+    int k = (int) dk, i;
+
+    if(dk - k > 0)
+        k++;
+    i = (k >> 3) + 1;
+    *K = -(-348 + 8*i);
+    c.f = CachedPowF[i];
+    c.e = CachedPowE[i];
+
+    return c;
+}
+
+/**
+ * Move the last digit closer to the actual value if there is room to.
+ */
+static void GrisuRound(char *buf, int len, uint64_t delta, uint64_t rest,
+                       uint64_t tenkappa, uint64_t wpw)
+{
+    while(rest < wpw && delta - rest >= tenkappa
+            && (rest + tenkappa < wpw || wpw - rest > rest + tenkappa - wpw)) {
+        buf[len-1]--;
+        rest += tenkappa;
+    }
+}
+
+/**
+ * Generate the shortest string of digits between the boundaries.
+ * @param W Scaled value
+ * @param Mp Scaled upper boundary
+ * @param delta Distance between the scaled boundaries
+ * @param buf Set to the digits
+ * @param len Set to the number of digits
+ * @param K Decimal exponent, updated for the digits generated
+ */
+static void DigitGen(diyfp W, diyfp Mp, uint64_t delta, char *buf, int *len,
+                     int *K)
+{
+    diyfp one;
+    uint64_t wpw = Mp.f - W.f, p2, tmp;
+    uint32_t p1, d;
+    int kappa;
+
+    one.f = 1ULL << -Mp.e;
+    one.e = Mp.e;
+    p1 = (uint32_t) (Mp.f >> -one.e);
+    p2 = Mp.f & (one.f - 1);
+
+    for(kappa=10; kappa>1 && p1<Pow10[kappa-1]; kappa--);
+    *len = 0;
+
+    /* Integer part */
+    while(kappa > 0) {
+        d = p1/(uint32_t) Pow10[kappa-1];
+        p1 %= (uint32_t) Pow10[kappa-1];
+        if(d || *len)
+            buf[(*len)++] = '0' + d;
+        kappa--;
+        tmp = ((uint64_t) p1 << -one.e) + p2;
+        if(tmp <= delta) {
+            *K += kappa;
+            GrisuRound(buf, *len, delta, tmp, (uint64_t) Pow10[kappa] << -one.e, wpw);
+            return;
+        }
+    }
+
+    /* Fractional part */
+    for(;;) {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t) (p2 >> -one.e);
+        if(d || *len)
+            buf[(*len)++] = '0' + d;
+        p2 &= one.f - 1;
+        kappa--;
+        if(p2 < delta) {
+            *K += kappa;
+            GrisuRound(buf, *len, delta, p2, one.f, (-kappa < 20) ? wpw*Pow10[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+/**
+ * Find the shortest digits that read back as a positive, finite double.
+ * @param x Value
+ * @param buf Set to the digits (at most 17, not null terminated)
+ * @param K Set to the decimal exponent: x = digits*10^K
+ * @returns Number of digits
+ */
+static int Grisu2(double x, char *buf, int *K)
+{
+    diyfp v, W, Wm, Wp, c;
+    int len;
+
+    v = DiyFpDouble(x);
+    DiyFpBoundaries(v, &Wm, &Wp);
+    c = CachedPower(Wp.e, K);
+    W = DiyFpMul(DiyFpNormalize(v), c);
+    Wp = DiyFpMul(Wp, c);
+    Wm = DiyFpMul(Wm, c);
+    Wm.f++;
+    Wp.f--;
+    DigitGen(W, Wp, Wp.f - Wm.f, buf, &len, K);
+
+    return len;
+}
+
+/**
+ * Format a double for a csv file. Like %g, numbers with a decimal exponent
+ * from -4 up to (but not including) the precision are written out in full,
+ * and everything else in scientific notation. Without a precision, numbers up
+ * to 1e15 are written out in full.
+ *
+ * With a precision, the digits are rounded from the shortest ones that read
+ * back exactly, which only gives the same digits as %g when there are fewer
+ * of them than the shortest representation has. That isn't true for
+ * precisions of CSVGRISUPRECISION or more, or for subnormal numbers (which
+ * have fewer significant bits), so those are formatted with %.*g instead.
+ * Precisions over CSVMAXPRECISION are treated as CSVMAXPRECISION, since that
+ * is already enough to read back exactly.
+ * @param s String to write to. This must have room for CSVFIELDMAX characters.
+ * @param x Value to format
+ * @param precision Number of significant digits, or 0 for the fewest digits
+ *      that read back as exactly the same value
+ * @returns Number of characters written (not counting the null terminator)
+ */
+int CSVFormatDouble(char *s, double x, int precision)
+{
+    char d[20], *p = s,
+         t[CSVFIELDMAX]; /* Digits from printf when rounding a tie */
+    int n, K, X, i,
+        P = (precision > 0) ? precision : 15; /* Largest exponent to write
+                                                 out in full */
+
+    if(isnan(x))
+        return sprintf(s, "nan");
+    if(precision > CSVMAXPRECISION)
+        precision = CSVMAXPRECISION;
+    if(precision >= CSVGRISUPRECISION
+            || (precision > 0 && fpclassify(x) == FP_SUBNORMAL))
+        return sprintf(s, "%.*g", precision, x);
+    if(signbit(x)) {
+        *p++ = '-';
+        x = -x;
+    }
+    if(isinf(x))
+        return p - s + sprintf(p, "inf");
+    if(x == 0) {
+        *p++ = '0';
+        *p = '\0';
+        return p - s;
+    }
+
+    n = Grisu2(x, d, &K);
+
+    /* Round to the requested number of digits. If the shortest digits end
+     * in a 5 right after the last one kept, they don't say which way the
+     * actual value rounds, so printf is left to work it out. */
+    if(precision > 0 && n == precision+1 && d[precision] == '5') {
+        sprintf(t, "%.*e", precision-1, x);
+        d[0] = t[0];
+        memcpy(d+1, t+2, precision-1);
+        n = precision;
+        K = atoi(strchr(t, 'e')+1) - (precision-1);
+    } else if(precision > 0 && n > precision) {
+        K += n - precision;
+        n = precision;
+        if(d[n] >= '5') {
+            for(i=n-1; i>=0 && d[i]=='9'; i--)
+                d[i] = '0';
+            if(i >= 0) {
+                d[i]++;
+            } else {
+                d[0] = '1';
+                K++;
+            }
+        }
+    }
+    /* Drop trailing zeros */
+    while(n > 1 && d[n-1] == '0') {
+        n--;
+        K++;
+    }
+
+    /* Decimal exponent of the first digit */
+    X = n + K - 1;
+
+    if(X >= -4 && X < P) {
+        if(X < 0) {
+            /* 0.000ddd */
+            *p++ = '0';
+            *p++ = '.';
+            for(i=0; i<-X-1; i++)
+                *p++ = '0';
+            memcpy(p, d, n);
+            p += n;
+        } else if(X+1 >= n) {
+            /* ddd000 */
+            memcpy(p, d, n);
+            p += n;
+            for(i=n; i<X+1; i++)
+                *p++ = '0';
+        } else {
+            /* dd.ddd */
+            memcpy(p, d, X+1);
+            p += X+1;
+            *p++ = '.';
+            memcpy(p, d+X+1, n-X-1);
+            p += n-X-1;
+        }
+        *p = '\0';
+        return p - s;
+    }
+
+    /* d.ddde+XX */
+    *p++ = d[0];
+    if(n > 1) {
+        *p++ = '.';
+        memcpy(p, d+1, n-1);
+        p += n-1;
+    }
+    return p - s + sprintf(p, "e%c%02d", X < 0 ? '-' : '+', abs(X));
+}
+
+/**
+ * Background thread that writes full buffers to the file.
+ * @param arg The csv writer
+ * @returns NULL
+ */
+static void* CSVFlushThread(void *arg)
+{
+    csvwriter *w = (csvwriter*) arg;
+    int i;
+
+    pthread_mutex_lock(&w->lock);
+    for(;;) {
+        while(w->pending < 0 && !w->done)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if(w->pending < 0)
+            break;
+        i = w->pending;
+        pthread_mutex_unlock(&w->lock);
+
+        fwrite(w->buf[i], 1, w->len[i], w->fp);
+
+        pthread_mutex_lock(&w->lock);
+        w->pending = -1;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+/**
+ * Open a csv file for writing.
+ * @param file Name of the file
+ * @param precision Number of significant digits, or 0 for the shortest
+ *      representation that reads back as the same value
+ * @param threaded If set, full buffers are written by a background thread
+ *      while the next one is being filled.
+ * @returns csv writer, or NULL if the file can't be opened
+ */
+csvwriter* CreateCSVWriter(char *file, int precision, int threaded)
+{
+    csvwriter *w;
+
+    w = (csvwriter*) calloc(sizeof(csvwriter), 1);
+    w->fp = fopen(file, "w");
+    if(!w->fp) {
+        free(w);
+        return NULL;
+    }
+    w->precision = precision;
+    w->buf[0] = (char*) malloc(CSVBUFSIZE);
+    w->pending = -1;
+
+    if(threaded) {
+        w->buf[1] = (char*) malloc(CSVBUFSIZE);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->cond, NULL);
+        w->threaded = !pthread_create(&w->thread, NULL, &CSVFlushThread, w);
+        if(!w->threaded) {
+            pthread_mutex_destroy(&w->lock);
+            pthread_cond_destroy(&w->cond);
+        }
+    }
+
+    return w;
+}
+
+/**
+ * Write out everything in the current buffer. With a background thread, this
+ * waits for the previous buffer to finish, hands the current one over, and
+ * switches to the other buffer.
+ * @param w csv writer
+ */
+void CSVFlush(csvwriter *w)
+{
+    if(w->pos == 0)
+        return;
+
+    if(!w->threaded) {
+        fwrite(w->buf[0], 1, w->pos, w->fp);
+        w->pos = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    while(w->pending >= 0)
+        pthread_cond_wait(&w->cond, &w->lock);
+    w->len[w->cur] = w->pos;
+    w->pending = w->cur;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    w->cur = !w->cur;
+    w->pos = 0;
+}
+
+/**
+ * Write any remaining data, close the file, and free the writer.
+ * @param w csv writer
+ * @returns 0 if everything was written successfully
+ */
+int DestroyCSVWriter(csvwriter *w)
+{
+    int status;
+
+    CSVFlush(w);
+    if(w->threaded) {
+        pthread_mutex_lock(&w->lock);
+        w->done = 1;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+    }
+
+    status = ferror(w->fp);
+    status |= fclose(w->fp);
+    free(w->buf[0]);
+    free(w->buf[1]);
+    free(w);
+
+    return status;
+}
+
+/**
+ * Make sure there is room for n more characters in the buffer.
+ */
+static void CSVReserve(csvwriter *w, size_t n)
+{
+    if(w->pos + n > CSVBUFSIZE)
+        CSVFlush(w);
+}
+
+/**
+ * Write a block of text (such as a header line) as is.
+ * @param w csv writer
+ * @param s Text to write
+ * @param n Number of characters
+ */
+void CSVWriteBytes(csvwriter *w, char *s, size_t n)
+{
+    size_t m;
+
+    while(n > 0) {
+        CSVReserve(w, (n < CSVBUFSIZE) ? n : CSVBUFSIZE);
+        m = CSVBUFSIZE - w->pos;
+        if(m > n)
+            m = n;
+        memcpy(w->buf[w->cur] + w->pos, s, m);
+        w->pos += m;
+        s += m;
+        n -= m;
+    }
+}
+
+/**
+ * Write a null terminated string as is.
+ * @param w csv writer
+ * @param s String to write
+ */
+void CSVWriteString(csvwriter *w, char *s)
+{
+    CSVWriteBytes(w, s, strlen(s));
+}
+
+/**
+ * Write one row of values.
+ * @param w csv writer
+ * @param v Values
+ * @param n Number of values
+ */
+void CSVWriteRow(csvwriter *w, double *v, int n)
+{
+    char *p;
+    int j;
+
+    CSVReserve(w, (size_t) n*(CSVFIELDMAX+1) + 1);
+    p = w->buf[w->cur] + w->pos;
+    for(j=0; j<n; j++) {
+        if(j)
+            *p++ = ',';
+        p += CSVFormatDouble(p, v[j], w->precision);
+    }
+    *p++ = '\n';
+    w->pos = p - w->buf[w->cur];
+}
+
+/**
+ * Write a set of vectors as the columns of the file, one row at a time, so
+ * that they never need to be copied into a matrix first.
+ * @param w csv writer
+ * @param cols Array of column vectors (all the same length)
+ * @param ncols Number of vectors
+ * @param sel Which columns to write, in order. If NULL, all of them are.
+ * @param nsel Number of columns in sel
+ */
+void CSVWriteVectors(csvwriter *w, vector **cols, int ncols, int *sel, int nsel)
+{
+    double *v;
+    int i, j, nrows;
+
+    if(!sel)
+        nsel = ncols;
+    if(ncols == 0 || nsel == 0)
+        return;
+    nrows = len(cols[0]);
+    v = (double*) calloc(sizeof(double), nsel);
+
+    for(i=0; i<nrows; i++) {
+        for(j=0; j<nsel; j++)
+            v[j] = valV(cols[sel ? sel[j] : j], i);
+        CSVWriteRow(w, v, nsel);
+    }
+
+    free(v);
+}
+
+/**
+ * Write the columns of a matrix.
+ * @param w csv writer
+ * @param m Matrix to write
+ * @param sel Which columns to write, in order. If NULL, all of them are.
+ * @param nsel Number of columns in sel
+ */
+void CSVWriteMatrix(csvwriter *w, matrix *m, int *sel, int nsel)
+{
+    double *v;
+    int i, j;
+
+    if(!sel)
+        nsel = nCols(m);
+    if(nsel == 0)
+        return;
+    v = (double*) calloc(sizeof(double), nsel);
+
+    for(i=0; i<nRows(m); i++) {
+        for(j=0; j<nsel; j++)
+            v[j] = val(m, i, sel ? sel[j] : j);
+        CSVWriteRow(w, v, nsel);
+    }
+
+    free(v);
+}
+
+/**
+ * Save a matrix to a csv file with a header. This can be used in place of
+ * mtxprntfilehdr.
+ * @param m Matrix to save
+ * @param file Name of the file
+ * @param header Header line (including the newline)
+ * @param precision Number of significant digits, or 0 for the shortest
+ *      representation
+ * @returns 0 on success
+ */
+int csvprntfilehdr(matrix *m, char *file, char *header, int precision)
+{
+    csvwriter *w;
+
+    w = CreateCSVWriter(file, precision, 0);
+    if(!w) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return 1;
+    }
+    CSVWriteString(w, header);
+    CSVWriteMatrix(w, m, NULL, 0);
+
+    return DestroyCSVWriter(w);
+}
+
@@ -0,0 +1,192 @@
+/**
+ * @file fftconv.c
+ * Discrete convolution with a uniformly sampled kernel using the fast Fourier
+ * transform. This calculates
+ * \f[ y_i = \sum_{k=0}^{m-1} K_k x_{i-k} \f]
+ * in O(n log m) time instead of O(nm). Long signals are split into blocks and
+ * handled with the overlap-save method, so the signal can be fed in a piece at
+ * a time as it is read.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fftconv.h"
+
+/**
+ * In-place radix-2 FFT.
+ * @param re Real part of the data
+ * @param im Imaginary part of the data
+ * @param n Number of points. Must be a power of 2.
+ * @param wre Real part of \f$\exp(-2\pi i k/n)\f$ for k < n/2
+ * @param wim Imaginary part of the twiddle factors
+ * @param inverse If nonzero, calculate the inverse transform (without the 1/n
+ *      scaling)
+ */
+static void fft(double *re, double *im, int n, double *wre, double *wim,
+                int inverse)
+{
+    int i, j, k, len, step;
+    double tre, tim, ure, uim, cw, sw;
+
+    /* Put the data in bit-reversed order */
+    for(i=1, j=0; i<n; i++) {
+        k = n >> 1;
+        for(; j & k; k >>= 1)
+            j ^= k;
+        j ^= k;
+        if(i < j) {
+            tre = re[i]; re[i] = re[j]; re[j] = tre;
+            tim = im[i]; im[i] = im[j]; im[j] = tim;
+        }
+    }
+
+    /* Combine pairs of transforms, doubling the length each time */
+    for(len=2; len<=n; len<<=1) {
+        step = n/len;
+        for(i=0; i<n; i+=len) {
+            for(k=0; k<len/2; k++) {
+                cw = wre[k*step];
+                sw = inverse ? -wim[k*step] : wim[k*step];
+                ure = re[i+k];
+                uim = im[i+k];
+                tre = re[i+k+len/2]*cw - im[i+k+len/2]*sw;
+                tim = re[i+k+len/2]*sw + im[i+k+len/2]*cw;
+                re[i+k] = ure + tre;
+                im[i+k] = uim + tim;
+                re[i+k+len/2] = ure - tre;
+                im[i+k+len/2] = uim - tim;
+            }
+        }
+    }
+}
+
+/**
+ * Set up a convolution with a fixed kernel. The FFT size is the smallest power
+ * of 2 that is at least twice the kernel length, which leaves room for at
+ * least m+1 new samples per block.
+ * @param K Kernel values. \f$K_0\f$ multiplies the current sample.
+ * @param m Number of kernel values
+ * @returns Convolution state
+ */
+fftconv* CreateFFTConv(double *K, int m)
+{
+    fftconv *c;
+    int i;
+
+    c = (fftconv*) calloc(sizeof(fftconv), 1);
+    c->m = m;
+    for(c->nfft=2; c->nfft<2*m; c->nfft<<=1);
+    c->block = c->nfft - m + 1;
+
+    c->Kre = (double*) calloc(sizeof(double), c->nfft);
+    c->Kim = (double*) calloc(sizeof(double), c->nfft);
+    c->wre = (double*) calloc(sizeof(double), c->nfft/2);
+    c->wim = (double*) calloc(sizeof(double), c->nfft/2);
+    c->buf = (double*) calloc(sizeof(double), c->nfft);
+    c->re = (double*) calloc(sizeof(double), c->nfft);
+    c->im = (double*) calloc(sizeof(double), c->nfft);
+
+    for(i=0; i<c->nfft/2; i++) {
+        c->wre[i] = cos(2*M_PI*i/c->nfft);
+        c->wim[i] = -sin(2*M_PI*i/c->nfft);
+    }
+
+    for(i=0; i<m; i++)
+        c->Kre[i] = K[i];
+    fft(c->Kre, c->Kim, c->nfft, c->wre, c->wim, 0);
+
+    return c;
+}
+
+/**
+ * Free a convolution state.
+ * @param c State to destroy
+ */
+void DestroyFFTConv(fftconv *c)
+{
+    free(c->Kre);
+    free(c->Kim);
+    free(c->wre);
+    free(c->wim);
+    free(c->buf);
+    free(c->re);
+    free(c->im);
+    free(c);
+}
+
+/**
+ * Forget all of the samples that have been fed in so far.
+ * @param c Convolution state
+ */
+void ResetFFTConv(fftconv *c)
+{
+    memset(c->buf, 0, sizeof(double)*c->nfft);
+}
+
+/**
+ * Convolve the next block of the signal with the kernel. Samples from earlier
+ * blocks are remembered, so calling this repeatedly on consecutive pieces of a
+ * signal gives the same result as convolving the whole thing at once.
+ * @param c Convolution state
+ * @param x Next n samples of the signal
+ * @param y Array to store the next n values of the convolution in
+ * @param n Number of samples. Must be no more than c->block.
+ * @returns Number of samples processed
+ */
+int FFTConvBlock(fftconv *c, double *x, double *y, int n)
+{
+    int i,
+        h = c->m - 1; /* Number of old samples kept */
+    double re, im;
+
+    if(n > c->block)
+        n = c->block;
+
+    for(i=0; i<n; i++)
+        c->buf[h+i] = x[i];
+    for(i=0; i<c->nfft; i++) {
+        c->re[i] = (i < h+n) ? c->buf[i] : 0;
+        c->im[i] = 0;
+    }
+
+    /* Multiply by the kernel in the frequency domain */
+    fft(c->re, c->im, c->nfft, c->wre, c->wim, 0);
+    for(i=0; i<c->nfft; i++) {
+        re = c->re[i]*c->Kre[i] - c->im[i]*c->Kim[i];
+        im = c->re[i]*c->Kim[i] + c->im[i]*c->Kre[i];
+        c->re[i] = re;
+        c->im[i] = im;
+    }
+    fft(c->re, c->im, c->nfft, c->wre, c->wim, 1);
+
+    /* The first m-1 values are wrapped around and get thrown out */
+    for(i=0; i<n; i++)
+        y[i] = c->re[h+i]/c->nfft;
+
+    /* Keep the last m-1 samples for the next block */
+    memmove(c->buf, c->buf+n, sizeof(double)*h);
+
+    return n;
+}
+
+/**
+ * Convolve an entire signal with a kernel.
+ * @param K Kernel values
+ * @param m Number of kernel values
+ * @param x Signal
+ * @param y Array to store the result in (same length as x)
+ * @param n Number of samples in the signal
+ */
+void FFTConvolve(double *K, int m, double *x, double *y, int n)
+{
+    fftconv *c;
+    int i;
+
+    c = CreateFFTConv(K, m);
+    for(i=0; i<n; i+=c->block)
+        FFTConvBlock(c, x+i, y+i, n-i);
+    DestroyFFTConv(c);
+}
+
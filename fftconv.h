@@ -0,0 +1,25 @@
+#ifndef FFTCONV_H
+#define FFTCONV_H
+
+/**
+ * State for convolving a long signal with a fixed kernel one block at a time
+ * using the overlap-save method.
+ */
+typedef struct {
+    int m, /* Length of the kernel */
+        nfft, /* Size of the FFT (a power of 2) */
+        block; /* Largest number of new samples that fit in one block */
+    double *Kre, *Kim, /* FFT of the kernel */
+           *wre, *wim, /* Twiddle factors */
+           *buf, /* Previous m-1 samples followed by the new samples */
+           *re, *im; /* Scratch space for the FFT */
+} fftconv;
+
+fftconv* CreateFFTConv(double*, int);
+void DestroyFFTConv(fftconv*);
+void ResetFFTConv(fftconv*);
+int FFTConvBlock(fftconv*, double*, double*, int);
+void FFTConvolve(double*, int, double*, double*, int);
+
+#endif
+
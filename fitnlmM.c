@@ -20,12 +20,13 @@
  * @param beta Column matrix of fitting parameters
  * @returns Jacobian matrix
  */
-matrix *CalcJacobianM(double (*model)(matrix *x, matrix *beta), matrix *x, matrix *beta)
+matrix *CalcJacobianM(double (*model)(mtxrow *x, matrix *beta), matrix *x, matrix *beta)
 {
     double h = 1e-10, /* Values used for numeric differentiation */
-           Jij; /* i-jth element of the J matrix */
-    matrix *J, /* Calculating this */
-           *xi; /* ith row of the supplied x values */
+           Jij, /* i-jth element of the J matrix */
+           fi; /* Model value at the current beta */
+    matrix *J; /* Calculating this */
+    mtxrow xi = {x, 0}; /* ith row of the supplied x values */
     int i, j, /* i is the row index for x, and j for beta */
         nx = nRows(x), /* Number of sets of x values */
         nbeta = nRows(beta); /* Number of fitting parameters */
@@ -40,15 +41,15 @@ matrix *CalcJacobianM(double (*model)(matrix *x, matrix *beta), matrix *x, matri
 
     J = CreateMatrix(nx, nbeta);
     for(i=0; i<nx; i++) {
-        xi = ExtractRow(x, i);
+        xi.row = i;
+        fi = model(&xi, beta);
         for(j=0; j<nbeta; j++) {
             /* Calculate the derivative of the model with respect to each
              * parameter. Each row is one x value. */
-            Jij = (model(xi, betah[j]) - model(xi, beta)) / h;
+            Jij = (model(&xi, betah[j]) - fi) / h;
             /* Save each Jij value into the J matrix */
             setval(J, Jij, i, j);
         }
-        DestroyMatrix(xi);
     }
 
     /* Get rid of the betah crap we made earlier */
@@ -69,48 +70,141 @@ matrix *CalcJacobianM(double (*model)(matrix *x, matrix *beta), matrix *x, matri
  * @param y Column vector of dependent values
  * @param beta Column vector of fitting parameters
  */
-matrix* CalcDyM(double (*model)(matrix *x, matrix *beta), matrix *x, matrix *y, matrix* beta)
+matrix* CalcDyM(double (*model)(mtxrow *x, matrix *beta), matrix *x, matrix *y, matrix* beta)
 {
     matrix* dy;
     int i;
     double yi; /* Individual y values */
-    matrix *xi; /* Actual x values */
+    mtxrow xi = {x, 0}; /* Actual x values */
 
     dy = CreateMatrix(nRows(x), 1);
 
     for(i=0; i<nRows(x); i++) {
         yi = val(y, i, 0); /* Current y value */
-        xi = ExtractRow(x, i); /* Current x value */
-        setval(dy, yi - model(xi, beta), i, 0); /* y - model(x, beta) */
-        DestroyMatrix(xi);
+        xi.row = i; /* Current x value */
+        setval(dy, yi - model(&xi, beta), i, 0); /* y - model(x, beta) */
     }
 
     return dy;
 }
 
+/**
+ * Take one Gauss-Newton step, updating beta in place.
+ * @param model Equation to fit
+ * @param x Matrix of x values
+ * @param y Column matrix of y values
+ * @param beta Column matrix of fitting parameters
+ * @returns How much each parameter changed
+ */
+static matrix* GaussNewtonStep(double (*model)(mtxrow*, matrix*),
+                               matrix *x, matrix *y, matrix *beta)
+{
+    matrix *J, /* Jacobian */
+           *Jt, /* Transpose of J */
+           *dy, /* Difference between the data and the model */
+           *A, *b, /* Coefficient and right hand side of the equation */
+           *dbeta; /* Amount beta needs to change by */
+    double M = 1; /* Slow down convergence so we don't overshoot */
+    int i;
+
+    /* Calculate the values of each matrix. */
+    dy = CalcDyM(model, x, y, beta);
+    J = CalcJacobianM(model, x, beta);
+    Jt = mtxtrn(J);
+    A = mtxmul(Jt, J);
+    b = mtxmul(Jt, dy);
+
+    /* Solve the system of equations for how far off the fitting parameters
+     * are. */
+    dbeta = SolveMatrixEquation(A, b);
+
+    /* beta = beta + dbeta */
+    for(i=0; i<nRows(beta); i++)
+        addval(beta, M*val(dbeta, i, 0), i, 0);
+
+    /* Delete all the clutter we created */
+    DestroyMatrix(J);
+    DestroyMatrix(Jt);
+    DestroyMatrix(A);
+    DestroyMatrix(dy);
+    DestroyMatrix(b);
+
+    return dbeta;
+}
+
+/**
+ * Get close to the solution using only part of the data. Large data sets are
+ * first fit on a stratified subsample of every stride-th row, and the stride
+ * is divided by FITCOARSEGROW each time the fit converges (or runs out of
+ * iterations) on the current subsample. Early iterations, when beta is far
+ * from the answer, only need enough points to head in the right direction.
+ * This stops before the full data set, which is left to the caller so that
+ * the final answer is checked against every row.
+ * @param model Equation to fit
+ * @param x Matrix of x values
+ * @param y Column matrix of y values
+ * @param beta Column matrix of fitting parameters. This is updated in place,
+ *      and is left alone if the fit on a subsample falls apart.
+ * @param tol Convergence tolerance for each subsample
+ */
+static void CoarseFit(double (*model)(mtxrow*, matrix*),
+                      matrix *x, matrix *y, matrix *beta, double tol)
+{
+    matrix *xs, *ys, /* Subsample of the data */
+           *dbeta, /* Change in beta on the last iteration */
+           *betas; /* Value of beta before the current subsample */
+    int stride = 1, /* Rows between samples */
+        iter, i, ok = 1;
+
+    while(nRows(x)/(stride*FITCOARSEGROW) >= FITCOARSEMIN)
+        stride *= FITCOARSEGROW;
+
+    for(; stride > 1 && ok; stride /= FITCOARSEGROW) {
+        xs = StrideRows(x, stride);
+        ys = StrideRows(y, stride);
+        betas = CopyMatrix(beta);
+
+        for(iter=0; iter<FITCOARSEITER; iter++) {
+            dbeta = GaussNewtonStep(model, xs, ys, beta);
+            for(i=0; i<nRows(beta); i++)
+                ok = ok && isfinite(val(beta, i, 0));
+            if(!ok || fabs(mtxextrm(dbeta)) <= tol) {
+                DestroyMatrix(dbeta);
+                break;
+            }
+            DestroyMatrix(dbeta);
+        }
+
+        /* Go back to where this subsample started if it blew up */
+        if(!ok)
+            for(i=0; i<nRows(beta); i++)
+                setval(beta, val(betas, i, 0), i, 0);
+
+        DestroyMatrix(xs);
+        DestroyMatrix(ys);
+        DestroyMatrix(betas);
+    }
+}
+
 /**
  * Fit the given model to the x-y data provided
  * \f[
  * J_{ij}J_{is} \Delta\beta_{s} = J_{ij} \Delta y_i
  * \f]
- * @param model Equation to fit
- * @param x Column matrix of x values
+ * @param model Equation to fit. Each call is passed a view of one row of x,
+ *      so model values are calculated without copying the data.
+ * @param x Matrix of x values, one row per data point
  * @param y Column matrix of y values
  * @param beta0: Matrix of coefficients for the model
  * @returns Column vector of fitted coefficients
  */
-matrix* fitnlmM(double (*model)(matrix* x, matrix *beta), matrix *x, matrix *y, matrix *beta0)
+matrix* fitnlmM(double (*model)(mtxrow* x, matrix *beta), matrix *x, matrix *y, matrix *beta0)
 {
-    matrix *J, /* Jacobian */
-           *Jt, /* Transpose of J */
-           *dy, /* dy value calculated in the function above */
-           *A, *b, /* Coefficient and right hand side of the equation */
-           *beta, /* Current values for the fitting parameters */
+    matrix *beta, /* Current values for the fitting parameters */
            *dbeta; /* Amount beta needs to change by after each iteration */
     /* Maximum amount of changed allowed for a single element of dbeta */
-    double tol = .001, M;
-    int i, /* Loop index */
-        maxiter = 500, /* Maximum number of iterations allowed */
+    double tol = .001;
+    int maxiter = 500, /* Maximum number of iterations allowed */
         iter = 0; /* Current iteration */
 
     /* Make a copy of beta so we don't overwrite the supplied values */
@@ -118,35 +212,16 @@ matrix* fitnlmM(double (*model)(matrix* x, matrix *beta), matrix *x, matrix *y,
     /* Set dbeta to NULL so that the program doesn't segfault */
     dbeta = NULL;
 
+    /* Start with part of the data if there's a lot of it */
+    CoarseFit(model, x, y, beta, tol);
+
     /* Loop until the change between iterations is less than the tolerance */
     do {
         /* Only delete dbeta if there's something to delete */
         if(dbeta)
             DestroyMatrix(dbeta);
 
-        /* Calculate the values of each matrix. */
-        dy = CalcDyM(model, x, y, beta);
-        J = CalcJacobianM(model, x, beta);
-        Jt = mtxtrn(J);
-        A = mtxmul(Jt, J);
-        b = mtxmul(Jt, dy);
-
-        /* Solve the system of equations for how far off the fitting parameters
-         * are. */
-        dbeta = SolveMatrixEquation(A, b);
-
-        M = 1; /* Slow down convergence so we don't overshoot */
-
-        /* beta = beta + dbeta */
-        for(i=0; i<nRows(beta); i++)
-            addval(beta, M*val(dbeta, i, 0), i, 0);
-
-        /* Delete all the clutter we created */
-        DestroyMatrix(J);
-        DestroyMatrix(Jt);
-        DestroyMatrix(A);
-        DestroyMatrix(dy);
-        DestroyMatrix(b);
+        dbeta = GaussNewtonStep(model, x, y, beta);
 
         /* Check to see how many iterations we've gone through and quit if it
          * doesn't look like we're going to come up with an answer */
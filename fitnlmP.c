@@ -85,6 +85,105 @@ matrix* CalcDy(double (*model)(double, matrix *, void *), matrix *x, matrix *y,
     return dy;
 }
 
+/**
+ * Take one Gauss-Newton step, updating beta in place.
+ * @param model Equation to fit
+ * @param x Matrix of x values
+ * @param y Column matrix of y values
+ * @param beta Column matrix of fitting parameters
+ * @param params Extra parameters passed to the model
+ * @returns How much each parameter changed
+ */
+static matrix* GaussNewtonStep(double (*model)(double, matrix*, void*),
+                               matrix *x, matrix *y, matrix *beta, void *params)
+{
+    matrix *J, /* Jacobian */
+           *Jt, /* Transpose of J */
+           *dy, /* Difference between the data and the model */
+           *A, *b, /* Coefficient and right hand side of the equation */
+           *dbeta; /* Amount beta needs to change by */
+    int i;
+
+    /* Calculate the values of each matrix. */
+    dy = CalcDy(model, x, y, beta, params);
+    J = CalcJacobian(model, x, beta, params);
+    Jt = mtxtrn(J);
+    A = mtxmul(Jt, J);
+    b = mtxmul(Jt, dy);
+
+    /* Solve the system of equations for how far off the fitting parameters
+     * are. */
+    dbeta = SolveMatrixEquation(A, b);
+
+    /* beta = beta + dbeta */
+    for(i=0; i<nRows(beta); i++)
+        addval(beta, val(dbeta, i, 0), i, 0);
+
+    /* Delete all the clutter we created */
+    DestroyMatrix(J);
+    DestroyMatrix(Jt);
+    DestroyMatrix(A);
+    DestroyMatrix(dy);
+    DestroyMatrix(b);
+
+    return dbeta;
+}
+
+/**
+ * Get close to the solution using only part of the data. Large data sets are
+ * first fit on a stratified subsample of every stride-th row, and the stride
+ * is divided by FITCOARSEGROW each time the fit converges (or runs out of
+ * iterations) on the current subsample. Early iterations, when beta is far
+ * from the answer, only need enough points to head in the right direction.
+ * This stops before the full data set, which is left to the caller so that
+ * the final answer is checked against every row.
+ * @param model Equation to fit
+ * @param x Matrix of x values
+ * @param y Column matrix of y values
+ * @param beta Column matrix of fitting parameters. This is updated in place,
+ *      and is left alone if the fit on a subsample falls apart.
+ * @param params Extra parameters passed to the model
+ * @param tol Convergence tolerance for each subsample
+ */
+static void CoarseFit(double (*model)(double, matrix*, void*),
+                      matrix *x, matrix *y, matrix *beta, void *params, double tol)
+{
+    matrix *xs, *ys, /* Subsample of the data */
+           *dbeta, /* Change in beta on the last iteration */
+           *betas; /* Value of beta before the current subsample */
+    int stride = 1, /* Rows between samples */
+        iter, i, ok = 1;
+
+    while(nRows(x)/(stride*FITCOARSEGROW) >= FITCOARSEMIN)
+        stride *= FITCOARSEGROW;
+
+    for(; stride > 1 && ok; stride /= FITCOARSEGROW) {
+        xs = StrideRows(x, stride);
+        ys = StrideRows(y, stride);
+        betas = CopyMatrix(beta);
+
+        for(iter=0; iter<FITCOARSEITER; iter++) {
+            dbeta = GaussNewtonStep(model, xs, ys, beta, params);
+            for(i=0; i<nRows(beta); i++)
+                ok = ok && isfinite(val(beta, i, 0));
+            if(!ok || fabs(mtxextrm(dbeta)) <= tol) {
+                DestroyMatrix(dbeta);
+                break;
+            }
+            DestroyMatrix(dbeta);
+        }
+
+        /* Go back to where this subsample started if it blew up */
+        if(!ok)
+            for(i=0; i<nRows(beta); i++)
+                setval(beta, val(betas, i, 0), i, 0);
+
+        DestroyMatrix(xs);
+        DestroyMatrix(ys);
+        DestroyMatrix(betas);
+    }
+}
+
 /**
  * Fit the given model to the x-y data provided
  * \f[
@@ -98,16 +197,11 @@ matrix* CalcDy(double (*model)(double, matrix *, void *), matrix *x, matrix *y,
  */
 matrix* fitnlmP(double (*model)(double, matrix*, void*), matrix *x, matrix *y, matrix *beta0, void *params)
 {
-    matrix *J, /* Jacobian */
-           *Jt, /* Transpose of J */
-           *dy, /* dy value calculated in the function above */
-           *A, *b, /* Coefficient and right hand side of the equation */
-           *beta, /* Current values for the fitting parameters */
+    matrix *beta, /* Current values for the fitting parameters */
            *dbeta; /* Amount beta needs to change by after each iteration */
     /* Maximum amount of changed allowed for a single element of dbeta */
     double tol = .001;
-    int i,
-        maxiter = 5000, /* Maximum number of iterations allowed */
+    int maxiter = 5000, /* Maximum number of iterations allowed */
         iter = 0; /* Current iteration */
 
     /* Make a copy of beta so we don't overwrite the supplied values */
@@ -115,33 +209,16 @@ matrix* fitnlmP(double (*model)(double, matrix*, void*), matrix *x, matrix *y, m
     /* Set dbeta to NULL so that the program doesn't segfault */
     dbeta = NULL;
 
+    /* Start with part of the data if there's a lot of it */
+    CoarseFit(model, x, y, beta, params, tol);
+
     /* Loop until the change between iterations is less than the tolerance */
     do {
         /* Only delete dbeta if there's something to delete */
         if(dbeta)
             DestroyMatrix(dbeta);
 
-        /* Calculate the values of each matrix. */
-        dy = CalcDy(model, x, y, beta, params);
-        J = CalcJacobian(model, x, beta, params);
-        Jt = mtxtrn(J);
-        A = mtxmul(Jt, J);
-        b = mtxmul(Jt, dy);
-
-        /* Solve the system of equations for how far off the fitting parameters
-         * are. */
-        dbeta = SolveMatrixEquation(A, b);
-
-        /* beta = beta + dbeta */
-        for(i=0; i<nRows(beta); i++)
-            addval(beta, val(dbeta, i, 0), i, 0);
-
-        /* Delete all the clutter we created */
-        DestroyMatrix(J);
-        DestroyMatrix(Jt);
-        DestroyMatrix(A);
-        DestroyMatrix(dy);
-        DestroyMatrix(b);
+        dbeta = GaussNewtonStep(model, x, y, beta, params);
 
         /* Check to see how many iterations we've gone through and quit if it
          * doesn't look like we're going to come up with an answer */
@@ -0,0 +1,452 @@
+/**
+ * @file hereditary.c
+ * Evaluate hereditary integrals of the form
+ * \f[
+ * \sigma(t) = \int_0^t\! G(t-\tau)\dot{\epsilon}(\tau)\,\mathrm{d}\tau
+ * \f]
+ * in linear time. When the kernel is a sum of exponentials, the integral can be
+ * updated from one time step to the next by decaying one state variable per
+ * mode, instead of summing over the entire history at every point.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "hereditary.h"
+
+#define PRONYSAMPLES 4 /* Number of points to fit per mode */
+#define PRONYRCOND 1e-12 /* Smallest pivot (relative to the largest) in the fit */
+
+/**
+ * Create a Prony series with all of the amplitudes set to zero.
+ * @param n Number of modes
+ * @returns New Prony series
+ */
+prony* CreateProny(int n)
+{
+    prony *p;
+
+    p = (prony*) calloc(sizeof(prony), 1);
+    p->n = n;
+    p->g = (double*) calloc(sizeof(double), n);
+    p->tau = (double*) calloc(sizeof(double), n);
+
+    return p;
+}
+
+/**
+ * Make a copy of a Prony series.
+ * @param p Prony series to copy
+ * @returns New Prony series
+ */
+prony* CopyProny(prony *p)
+{
+    prony *c;
+    int i;
+
+    c = CreateProny(p->n);
+    c->ginf = p->ginf;
+    c->err = p->err;
+    for(i=0; i<p->n; i++) {
+        c->g[i] = p->g[i];
+        c->tau[i] = p->tau[i];
+    }
+
+    return c;
+}
+
+/**
+ * Free a Prony series.
+ * @param p Prony series to destroy
+ */
+void DestroyProny(prony *p)
+{
+    free(p->g);
+    free(p->tau);
+    free(p);
+}
+
+/**
+ * Solve a linear least squares problem by Householder QR. Unlike the normal
+ * equations, this doesn't square the condition number, which matters here
+ * since neighboring exponentials look a lot alike. Columns that are (almost)
+ * linearly dependent on the ones before them get a coefficient of zero.
+ * @param A Matrix of basis function values, stored by row (m by n). This is
+ *      overwritten.
+ * @param b Right hand side (m values). Also overwritten.
+ * @param m Number of points
+ * @param n Number of coefficients (no more than m)
+ * @param x Set to the fitted coefficients (n values)
+ */
+static void PronyLeastSquares(double *A, double *b, int m, int n, double *x)
+{
+    double *v, /* Householder vector */
+           norm, alpha, vv, d, rmax = 0;
+    int i, j, k;
+
+    v = (double*) calloc(sizeof(double), m);
+    for(k=0; k<n; k++) {
+        norm = 0;
+        for(i=k; i<m; i++)
+            norm += A[i*n+k]*A[i*n+k];
+        norm = sqrt(norm);
+        if(norm == 0)
+            continue;
+
+        /* Reflect column k onto the axis */
+        alpha = (A[k*n+k] > 0) ? -norm : norm;
+        vv = 0;
+        for(i=k; i<m; i++) {
+            v[i] = A[i*n+k] - ((i == k) ? alpha : 0);
+            vv += v[i]*v[i];
+        }
+        if(vv == 0)
+            continue;
+        for(j=k; j<n; j++) {
+            d = 0;
+            for(i=k; i<m; i++)
+                d += v[i]*A[i*n+j];
+            d *= 2/vv;
+            for(i=k; i<m; i++)
+                A[i*n+j] -= d*v[i];
+        }
+        d = 0;
+        for(i=k; i<m; i++)
+            d += v[i]*b[i];
+        d *= 2/vv;
+        for(i=k; i<m; i++)
+            b[i] -= d*v[i];
+    }
+    free(v);
+
+    /* Back substitution */
+    for(k=0; k<n; k++)
+        rmax = fmax(rmax, fabs(A[k*n+k]));
+    for(k=n-1; k>=0; k--) {
+        if(fabs(A[k*n+k]) <= PRONYRCOND*rmax) {
+            x[k] = 0;
+            continue;
+        }
+        d = b[k];
+        for(j=k+1; j<n; j++)
+            d -= A[k*n+j]*x[j];
+        x[k] = d/A[k*n+k];
+    }
+}
+
+/**
+ * Fit a relaxation function to a Prony series with a fixed number of modes per
+ * decade. Series fit over the same range with the same density always have
+ * the same relaxation times.
+ * @param G Relaxation function (see FitProny)
+ * @param params Extra parameters for the relaxation function
+ * @param tmin Shortest time the series needs to be accurate for [s]. If this
+ *      isn't positive, it is set to a thousandth of tmax.
+ * @param tmax Longest time the series needs to be accurate for [s]. If this
+ *      is no more than tmin, the series covers one decade starting at tmin.
+ * @param density Number of modes per decade
+ * @returns Fitted Prony series, with the error in the err field
+ */
+prony* FitPronyDensity(double (*G)(double, void*), void *params,
+                        double tmin, double tmax, int density)
+{
+    prony *p;
+    double *A, /* Value of each mode (weighted) at each point */
+           *b, /* Weighted values of G */
+           *beta, /* Fitted amplitudes */
+           decades, /* Number of decades of time to cover */
+           ti, Gi, Gs, err;
+    int n, /* Number of modes */
+        ns, /* Number of points to fit */
+        i, j;
+
+    /* Make sure there's a real range of times to fit over, so there are at
+     * least two modes */
+    if(!(tmin > 0) || !isfinite(tmin))
+        tmin = (tmax > 0 && isfinite(tmax)) ? 1e-3*tmax : 1;
+    if(!(tmax > tmin) || !isfinite(tmax))
+        tmax = 10*tmin;
+    decades = log10(tmax/tmin);
+    if(density < 1)
+        density = 1;
+
+    n = (int) ceil(density*decades) + 1;
+    ns = PRONYSAMPLES*n;
+    p = CreateProny(n);
+
+    for(j=0; j<n; j++)
+        p->tau[j] = tmin*pow(10, decades*j/(n-1));
+
+    A = (double*) calloc(sizeof(double), ns*(n+1));
+    b = (double*) calloc(sizeof(double), ns);
+    beta = (double*) calloc(sizeof(double), n+1);
+    for(i=0; i<ns; i++) {
+        ti = tmin*pow(10, decades*i/(ns-1));
+        Gi = fabs(G(ti, params));
+        if(Gi == 0)
+            Gi = 1;
+
+        b[i] = G(ti, params)/Gi;
+        A[i*(n+1)] = 1/Gi;
+        for(j=0; j<n; j++)
+            A[i*(n+1)+j+1] = exp(-ti/p->tau[j])/Gi;
+    }
+
+    PronyLeastSquares(A, b, ns, n+1, beta);
+    p->ginf = beta[0];
+    for(j=0; j<n; j++)
+        p->g[j] = beta[j+1];
+
+    /* Check the fit halfway (in log time) between each pair of points it was
+     * fit at, as well as at the ends */
+    p->err = 0;
+    for(i=0; i<2*ns-1; i++) {
+        ti = tmin*pow(10, decades*i/(2*ns-2));
+        Gi = G(ti, params);
+        Gs = fabs(Gi) > 0 ? fabs(Gi) : 1;
+        err = fabs(PronyRelax(p, ti) - Gi)/Gs;
+        if(!(err <= p->err))
+            p->err = err;
+    }
+
+    free(A);
+    free(b);
+    free(beta);
+
+    return p;
+}
+
+/**
+ * Fit an arbitrary relaxation function to a Prony series. The relaxation times
+ * are fixed and spaced logarithmically between tmin and tmax, so only the
+ * amplitudes need to be fit. This makes the fit linear, and it is done by
+ * weighted least squares (with QR, see PronyLeastSquares) on points spaced
+ * logarithmically over the same range. Each point is weighted by 1/G(t) so
+ * that the relative error is minimized.
+ *
+ * The fit starts with PRONYDENSITY modes per decade. It is then checked
+ * halfway between the points it was fit at, and the number of modes per decade
+ * is doubled (up to PRONYMAXDENSITY) until the relative error is below
+ * PRONYTOL. The error that was reached is saved in the err field. Since
+ * \f$|G - G_p| \le \epsilon |G|\f$, a hereditary integral calculated with the
+ * series is off by at most \f$\epsilon \sum_j |G(t_i-t_j)||\Delta e_j|\f$.
+ *
+ * The kernels used with this come from material-data as functions of time,
+ * temperature, and moisture content (MaxwellRelax, MaxwellRelaxLaura), which
+ * is why they are fit instead of being split into their own modes.
+ *
+ * The relaxation times depend on the density that was needed, so series that
+ * have to share a hereditary state (see HereditaryStep) should be fit with
+ * FitPronyDensity instead.
+ * @param G Relaxation function. The first argument is time, and the second is
+ *      passed through from params.
+ * @param params Extra parameters for the relaxation function
+ * @param tmin Shortest time the series needs to be accurate for [s]
+ * @param tmax Longest time the series needs to be accurate for [s]
+ * @returns Fitted Prony series
+ */
+prony* FitProny(double (*G)(double, void*), void *params,
+                double tmin, double tmax)
+{
+    prony *p, *q;
+    int density;
+
+    p = FitPronyDensity(G, params, tmin, tmax, PRONYDENSITY);
+    for(density=2*PRONYDENSITY; !(p->err <= PRONYTOL)
+            && density <= PRONYMAXDENSITY; density *= 2) {
+        q = FitPronyDensity(G, params, tmin, tmax, density);
+        if(q->err < p->err || isnan(p->err)) {
+            DestroyProny(p);
+            p = q;
+        } else {
+            DestroyProny(q);
+        }
+    }
+
+    return p;
+}
+
+/**
+ * Evaluate a Prony series.
+ * @param p Prony series
+ * @param t Time [s]
+ * @returns G(t)
+ */
+double PronyRelax(prony *p, double t)
+{
+    double G = p->ginf;
+    int i;
+
+    for(i=0; i<p->n; i++)
+        G += p->g[i]*exp(-t/p->tau[i]);
+
+    return G;
+}
+
+/**
+ * Calculate the storage modulus for a Prony series at a given frequency.
+ * \f[
+ * E'(\omega) = G_\infty + \sum_k g_k \frac{\omega^2\tau_k^2}{1+\omega^2\tau_k^2}
+ * \f]
+ * @param p Prony series
+ * @param w Angular frequency [rad/s]
+ * @returns Storage modulus
+ */
+double PronyStorage(prony *p, double w)
+{
+    double E = p->ginf, wt;
+    int i;
+
+    for(i=0; i<p->n; i++) {
+        wt = w*p->tau[i];
+        E += p->g[i]*wt*wt/(1+wt*wt);
+    }
+
+    return E;
+}
+
+/**
+ * Calculate the loss modulus for a Prony series at a given frequency.
+ * \f[
+ * E''(\omega) = \sum_k g_k \frac{\omega\tau_k}{1+\omega^2\tau_k^2}
+ * \f]
+ * @param p Prony series
+ * @param w Angular frequency [rad/s]
+ * @returns Loss modulus
+ */
+double PronyLoss(prony *p, double w)
+{
+    double E = 0, wt;
+    int i;
+
+    for(i=0; i<p->n; i++) {
+        wt = w*p->tau[i];
+        E += p->g[i]*wt/(1+wt*wt);
+    }
+
+    return E;
+}
+
+/**
+ * Calculate the storage modulus, loss modulus, and loss tangent for a Prony
+ * series at a whole set of frequencies at once.
+ * @param p Prony series
+ * @param w Array of angular frequencies [rad/s]
+ * @param n Number of frequencies
+ * @param E1 Array to store the storage modulus in. May be NULL.
+ * @param E2 Array to store the loss modulus in. May be NULL.
+ * @param tand Array to store the loss tangent in. May be NULL.
+ */
+void PronyModulus(prony *p, double *w, int n,
+                  double *E1, double *E2, double *tand)
+{
+    double Es, El, wt, f;
+    int i, k;
+
+    for(i=0; i<n; i++) {
+        Es = p->ginf;
+        El = 0;
+        for(k=0; k<p->n; k++) {
+            wt = w[i]*p->tau[k];
+            f = p->g[k]*wt/(1+wt*wt);
+            Es += f*wt;
+            El += f;
+        }
+        if(E1)
+            E1[i] = Es;
+        if(E2)
+            E2[i] = El;
+        if(tand)
+            tand[i] = El/Es;
+    }
+}
+
+/**
+ * Set up a hereditary integral using the relaxation times from a Prony series.
+ * @param p Prony series. Only the relaxation times are used.
+ * @returns New hereditary integral state, with nothing in its history
+ */
+hereditary* CreateHereditary(prony *p)
+{
+    hereditary *h;
+    int i;
+
+    h = (hereditary*) calloc(sizeof(hereditary), 1);
+    h->n = p->n;
+    h->tau = (double*) calloc(sizeof(double), p->n);
+    h->h = (double*) calloc(sizeof(double), p->n);
+    h->decay = (double*) calloc(sizeof(double), p->n);
+    for(i=0; i<p->n; i++)
+        h->tau[i] = p->tau[i];
+    h->dt = -1;
+
+    return h;
+}
+
+/**
+ * Free a hereditary integral state.
+ * @param h State to destroy
+ */
+void DestroyHereditary(hereditary *h)
+{
+    free(h->tau);
+    free(h->h);
+    free(h->decay);
+    free(h);
+}
+
+/**
+ * Forget the entire history of a hereditary integral.
+ * @param h State to reset
+ */
+void ResetHereditary(hereditary *h)
+{
+    int i;
+
+    for(i=0; i<h->n; i++)
+        h->h[i] = 0;
+    h->hinf = 0;
+}
+
+/**
+ * Advance a hereditary integral by one time step. This calculates
+ * \f[
+ * \sigma_i = \sum_{j<i} G_j(t_i-t_j) \Delta\epsilon_j
+ * \f]
+ * by first decaying the contribution from each mode by
+ * \f$\exp(-\Delta t/\tau_k)\f$, and then adding in the new increment, which
+ * only shows up in the value returned by the next step. This makes each step
+ * O(modes) instead of O(i).
+ *
+ * The kernel can be different for each increment (for example, if it depends
+ * on moisture content), as long as the relaxation times are the same as the
+ * ones the state was created with.
+ * @param h Hereditary integral state
+ * @param p Prony series to use for the new increment
+ * @param dt Time since the last step [s]
+ * @param de Increment of strain (or whatever is being integrated) at this step
+ * @returns Value of the integral at this step, not including de
+ */
+double HereditaryStep(hereditary *h, prony *p, double dt, double de)
+{
+    double s; /* Value of the integral */
+    int i;
+
+    /* Only recalculate the exponentials when the time step changes */
+    if(dt != h->dt) {
+        for(i=0; i<h->n; i++)
+            h->decay[i] = exp(-dt/h->tau[i]);
+        h->dt = dt;
+    }
+
+    s = h->hinf;
+    for(i=0; i<h->n; i++) {
+        h->h[i] *= h->decay[i];
+        s += h->h[i];
+        h->h[i] += p->g[i]*de;
+    }
+    h->hinf += p->ginf*de;
+
+    return s;
+}
+
@@ -0,0 +1,49 @@
+#ifndef HEREDITARY_H
+#define HEREDITARY_H
+
+#define PRONYDENSITY 3 /* Number of modes per decade of time to start with */
+#define PRONYMAXDENSITY 24 /* Most modes per decade of time */
+#define PRONYTOL 1e-4 /* Largest relative error in a fitted relaxation function */
+
+/**
+ * Relaxation function written as a Prony series:
+ * \f[ G(t) = G_\infty + \sum_k g_k \exp(-t/\tau_k) \f]
+ */
+typedef struct {
+    int n; /* Number of modes */
+    double ginf, /* Long time modulus */
+           err, /* Largest relative error from fitting (see FitProny) */
+           *g, /* Amplitude of each mode */
+           *tau; /* Relaxation time of each mode */
+} prony;
+
+/**
+ * Running state for a hereditary integral with a Prony series kernel. There is
+ * one state variable for each mode.
+ */
+typedef struct {
+    int n; /* Number of modes */
+    double *tau, /* Relaxation time of each mode */
+           *h, /* Contribution of each mode to the integral */
+           *decay, /* exp(-dt/tau) for the last time step */
+           hinf, /* Contribution of the long time modulus */
+           dt; /* Time step the decay factors were calculated for */
+} hereditary;
+
+prony* CreateProny(int);
+prony* CopyProny(prony*);
+void DestroyProny(prony*);
+prony* FitPronyDensity(double (*)(double, void*), void*, double, double, int);
+prony* FitProny(double (*)(double, void*), void*, double, double);
+double PronyRelax(prony*, double);
+double PronyStorage(prony*, double);
+double PronyLoss(prony*, double);
+void PronyModulus(prony*, double*, int, double*, double*, double*);
+
+hereditary* CreateHereditary(prony*);
+void DestroyHereditary(hereditary*);
+void ResetHereditary(hereditary*);
+double HereditaryStep(hereditary*, prony*, double, double);
+
+#endif
+
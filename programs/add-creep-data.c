@@ -1,5 +1,8 @@
 #include "matrix.h"
+#include "csv.h"
+#include "colfile.h"
 #include "material-data.h"
+#include "creep-lookup.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
@@ -7,18 +10,21 @@
 int main(int argc, char *argv[])
 {
 
-    int i;
-    matrix *input, *output;
-    double tcol=0,
-           xcol=1,
-           ucol=2,
-           j0col=3,
-           j1col=4,
-           j2col=5,
-           tau1col=6,
-           tau2col=7,
-           T, ti, xi, ui;
+    int i,
+        tcol=0,
+        xcol=1,
+        ucol=2,
+        j0col=3,
+        j1col=4,
+        j2col=5,
+        tau1col=6,
+        tau2col=7;
+    csvtable *input;
+    matrix *output;
+    double T, ti, xi, ui,
+           J0, J1, J2, tau1, tau2;
     char *femdata, *creepdata, *outfile;
+    creeptable *creep;
 
     if(argc != 5) {
         printf("Usage:\n"
@@ -34,25 +40,44 @@ int main(int argc, char *argv[])
     creepdata = argv[2];
     T = atof(argv[3]);
     outfile = argv[4];
-    
-    input = mtxloadcsv(femdata, 1);
-    output = CreateMatrix(nRows(input), 8);
-    for(i=0; i<nRows(input); i++) {
-        ti = val(input, i, tcol);
-        xi = val(input, i, xcol);
-        ui = val(input, i, ucol);
+
+    /* Load the creep data once instead of looking it up for every row */
+    creep = LoadCreepTable(creepdata);
+    if(!creep) {
+        fprintf(stderr, "Unable to load %s\n", creepdata);
+        exit(1);
+    }
+    if(fabs(creep->T - T) > .5)
+        fprintf(stderr, "Warning: %s is for T = %g K, not %g K\n",
+                creepdata, creep->T, T);
+
+    input = CSVLoadCached(femdata, 1);
+    if(!input || input->ncols <= ucol) {
+        fprintf(stderr, "Unable to load %s\n", femdata);
+        exit(1);
+    }
+    output = CreateMatrix(input->nrows, 8);
+    for(i=0; i<input->nrows; i++) {
+        ti = csvval(input, i, tcol);
+        xi = csvval(input, i, xcol);
+        ui = csvval(input, i, ucol);
 
         setval(output, ti, i, tcol);
         setval(output, xi, i, xcol);
         setval(output, ui, i, ucol);
-        setval(output, CreepLookupJ0(creepdata, T, xi), i, j0col);
-        setval(output, CreepLookupJ1(creepdata, T, xi), i, j1col);
-        setval(output, CreepLookupJ2(creepdata, T, xi), i, j2col);
-        setval(output, CreepLookupTau1(creepdata, T, xi), i, tau1col);
-        setval(output, CreepLookupTau2(creepdata, T, xi), i, tau2col);
+        CreepTableLookup(creep, xi, &J0, &J1, &J2, &tau1, &tau2);
+        setval(output, J0, i, j0col);
+        setval(output, J1, i, j1col);
+        setval(output, J2, i, j2col);
+        setval(output, tau1, i, tau1col);
+        setval(output, tau2, i, tau2col);
     }
 
-    mtxprntfilehdr(output, outfile, "t,Xdb,u,J0,J1,J2,tau1,tau2\n");
+    csvprntfilehdr(output, outfile, "t,Xdb,u,J0,J1,J2,tau1,tau2\n", 0);
+
+    DestroyCreepTable(creep);
+    DestroyCSVTable(input);
+    DestroyMatrix(output);
 
     return 0;
 }
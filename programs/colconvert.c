@@ -0,0 +1,55 @@
+/**
+ * @file colconvert.c
+ * Convert csv files to binary column files and back.
+ */
+
+#include "csv.h"
+#include "colfile.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    csvtable *t;
+    char *header;
+    int skip, status;
+
+    if(argc < 3) {
+        puts("Usage:");
+        puts("colconvert <infile> <outfile> [skip]");
+        puts("infile: csv file or column file to convert. Column files are");
+        puts("    converted to csv, and anything else is converted to a column");
+        puts("    file.");
+        puts("outfile: Name of the file to save.");
+        puts("skip: Number of header lines in the csv file (default 1). Column");
+        puts("    names and units are taken from the last one.");
+        return 0;
+    }
+    skip = (argc > 3) ? atoi(argv[3]) : 1;
+
+    /* Column file to csv */
+    t = ColFileLoad(argv[1]);
+    if(t) {
+        status = ColFileToCSV(t, argv[2], 0);
+        DestroyCSVTable(t);
+        return status != 0;
+    }
+
+    /* csv to column file */
+    t = CSVLoad(argv[1], skip);
+    if(!t) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
+    header = ColFileHeaderLine(argv[1], skip);
+    status = ColFileWrite(argv[2], t, header);
+    if(status)
+        fprintf(stderr, "Unable to save %s\n", argv[2]);
+    printf("%d rows, %d columns\n", t->nrows, t->ncols);
+
+    free(header);
+    DestroyCSVTable(t);
+
+    return status != 0;
+}
+
@@ -0,0 +1,360 @@
+/**
+ * @file creep-lookup.c
+ * Load a table of creep parameters (from creep-table) once and look up values
+ * from it by interpolating in moisture content, or in both temperature and
+ * moisture content.
+ */
+
+#include "matrix.h"
+#include "csv.h"
+#include "colfile.h"
+#include "creep-lookup.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define CREEPGRIDTOL 1e-3 /* Allowed deviation from an even grid (fraction of dM) */
+#define CREEPNPARAM 5 /* Number of creep parameters (J0, J1, tau1, J2, tau2) */
+
+/**
+ * Load a creep table from a csv file with the columns T, M, J0, J1, tau1, J2,
+ * and tau2 and one header row. The rows must be sorted by moisture content. If
+ * they are evenly spaced (as they are when made by creep-table), lookups go
+ * straight to the right row instead of searching for it.
+ * @param file Name of the csv file
+ * @returns Creep table, or NULL if the file has fewer than 2 rows or is
+ *      missing any columns.
+ */
+creeptable* LoadCreepTable(char *file)
+{
+    creeptable *c;
+    csvtable *data;
+    int i;
+
+    data = CSVLoadCached(file, 1);
+    if(!data)
+        return NULL;
+    if(data->nrows < 2 || data->ncols < 2+CREEPNPARAM) {
+        DestroyCSVTable(data);
+        return NULL;
+    }
+
+    c = (creeptable*) calloc(sizeof(creeptable), 1);
+    c->n = data->nrows;
+    c->T = csvval(data, 0, 0);
+    c->M = (double*) calloc(sizeof(double), 6*c->n);
+    c->J0 = c->M + c->n;
+    c->J1 = c->M + 2*c->n;
+    c->tau1 = c->M + 3*c->n;
+    c->J2 = c->M + 4*c->n;
+    c->tau2 = c->M + 5*c->n;
+
+    for(i=0; i<c->n; i++) {
+        c->M[i] = csvval(data, i, 1);
+        c->J0[i] = csvval(data, i, 2);
+        c->J1[i] = csvval(data, i, 3);
+        c->tau1[i] = csvval(data, i, 4);
+        c->J2[i] = csvval(data, i, 5);
+        c->tau2[i] = csvval(data, i, 6);
+    }
+    DestroyCSVTable(data);
+
+    /* Check whether the moisture contents are evenly spaced */
+    c->Mmin = c->M[0];
+    c->dM = (c->M[c->n-1] - c->M[0])/(c->n-1);
+    for(i=0; i<c->n; i++) {
+        if(fabs(c->M[i] - (c->Mmin + i*c->dM)) > CREEPGRIDTOL*c->dM) {
+            c->dM = 0;
+            break;
+        }
+    }
+
+    return c;
+}
+
+/**
+ * Free a creep table.
+ * @param c Table to destroy
+ */
+void DestroyCreepTable(creeptable *c)
+{
+    free(c->M);
+    free(c);
+}
+
+/**
+ * Look up all of the creep parameters at a moisture content by linear
+ * interpolation between the nearest two rows. Moisture contents outside the
+ * table get the values from the first or last row.
+ * @param c Creep table
+ * @param M Moisture content [kg/kg db]
+ * @param J0 Set to the instantaneous compliance
+ * @param J1 Set to the compliance of the first mode
+ * @param J2 Set to the compliance of the second mode
+ * @param tau1 Set to the retardation time of the first mode
+ * @param tau2 Set to the retardation time of the second mode
+ */
+void CreepTableLookup(creeptable *c, double M, double *J0, double *J1,
+                      double *J2, double *tau1, double *tau2)
+{
+    int i, lo, hi;
+    double f;
+
+    if(M <= c->M[0]) {
+        i = 0;
+        f = 0;
+    } else if(M >= c->M[c->n-1]) {
+        i = c->n-2;
+        f = 1;
+    } else {
+        if(c->dM > 0) {
+            /* Even grid: go straight to the right row */
+            i = (int) ((M - c->Mmin)/c->dM);
+            if(i > c->n-2)
+                i = c->n-2;
+            /* Correct for any rounding in the saved moisture contents */
+            while(i > 0 && M < c->M[i])
+                i--;
+            while(i < c->n-2 && M >= c->M[i+1])
+                i++;
+        } else {
+            /* Binary search */
+            lo = 0;
+            hi = c->n-1;
+            while(hi - lo > 1) {
+                i = (lo+hi)/2;
+                if(c->M[i] <= M)
+                    lo = i;
+                else
+                    hi = i;
+            }
+            i = lo;
+        }
+        f = (M - c->M[i])/(c->M[i+1] - c->M[i]);
+    }
+
+    *J0 = c->J0[i] + f*(c->J0[i+1] - c->J0[i]);
+    *J1 = c->J1[i] + f*(c->J1[i+1] - c->J1[i]);
+    *J2 = c->J2[i] + f*(c->J2[i+1] - c->J2[i]);
+    *tau1 = c->tau1[i] + f*(c->tau1[i+1] - c->tau1[i]);
+    *tau2 = c->tau2[i] + f*(c->tau2[i+1] - c->tau2[i]);
+}
+
+/**
+ * Estimate the derivative of a grid of values along one direction, in units of
+ * the grid spacing. Central differences are used on the inside of the grid and
+ * one-sided differences on the edges.
+ * @param f Grid values
+ * @param i Index of the point
+ * @param n Number of points in this direction
+ * @param stride Distance between neighboring points in this direction
+ * @returns Derivative
+ */
+static double griddiff(double *f, int i, int n, int stride)
+{
+    if(n < 2)
+        return 0;
+    if(i == 0)
+        return f[stride] - f[0];
+    if(i == n-1)
+        return f[0] - f[-stride];
+    return .5*(f[stride] - f[-stride]);
+}
+
+/**
+ * Load a table of creep parameters over both temperature and moisture content
+ * (from creep-table <Tmin> <Tmax> <nT> <Mmin> <Mmax> <nM>) and calculate the
+ * coefficients of a bicubic patch for each cell of the grid. The slopes at
+ * each grid point are estimated by finite differences, so the surface goes
+ * through every point in the table and has continuous first derivatives.
+ * @param file Name of the csv file. The rows must be sorted by temperature and
+ *      then by moisture content, with both evenly spaced.
+ * @returns Creep surface, or NULL if the file isn't a complete, evenly spaced
+ *      grid or is missing any columns.
+ */
+creepsurface* LoadCreepSurface(char *file)
+{
+    creepsurface *s;
+    csvtable *data;
+    double *f, /* Values of one parameter at each grid point */
+           *fT, *fM, *fTM, /* Derivatives of f (in units of grid spacing) */
+           F[4][4], /* Values and derivatives at the corners of a cell */
+           LF[4][4], /* L*F */
+           *a; /* Coefficients for one cell */
+    int n, nT, nM, i, j, k, p, q, r, u;
+    /* Converts corner values and derivatives into polynomial coefficients */
+    static const double L[4][4] = {{1, 0, 0, 0},
+                                   {0, 0, 1, 0},
+                                   {-3, 3, -2, -1},
+                                   {2, -2, 1, 1}};
+
+    data = CSVLoadCached(file, 1);
+    if(!data)
+        return NULL;
+    n = data->nrows;
+    if(data->ncols < 2+CREEPNPARAM) {
+        DestroyCSVTable(data);
+        return NULL;
+    }
+
+    /* Count the moisture contents at the first temperature */
+    for(nM=1; nM<n && csvval(data, nM, 0) == csvval(data, 0, 0); nM++);
+    nT = n/nM;
+    if(nT < 2 || nM < 2 || nT*nM != n) {
+        DestroyCSVTable(data);
+        return NULL;
+    }
+
+    s = (creepsurface*) calloc(sizeof(creepsurface), 1);
+    s->nT = nT;
+    s->nM = nM;
+    s->Tmin = csvval(data, 0, 0);
+    s->dT = (csvval(data, n-1, 0) - s->Tmin)/(nT-1);
+    s->Mmin = csvval(data, 0, 1);
+    s->dM = (csvval(data, nM-1, 1) - s->Mmin)/(nM-1);
+
+    /* Make sure the grid is evenly spaced */
+    for(i=0; i<n; i++) {
+        if(fabs(csvval(data, i, 0) - (s->Tmin + (i/nM)*s->dT)) > CREEPGRIDTOL*s->dT
+                || fabs(csvval(data, i, 1) - (s->Mmin + (i%nM)*s->dM)) > CREEPGRIDTOL*s->dM) {
+            DestroyCSVTable(data);
+            free(s);
+            return NULL;
+        }
+    }
+
+    s->coef = (double*) calloc(sizeof(double), 16*CREEPNPARAM*(nT-1)*(nM-1));
+    f = (double*) calloc(sizeof(double), 4*n);
+    fT = f + n;
+    fM = f + 2*n;
+    fTM = f + 3*n;
+
+    for(p=0; p<CREEPNPARAM; p++) {
+        for(k=0; k<n; k++)
+            f[k] = csvval(data, k, p+2);
+        for(k=0; k<n; k++) {
+            fT[k] = griddiff(f+k, k/nM, nT, nM);
+            fM[k] = griddiff(f+k, k%nM, nM, 1);
+        }
+        for(k=0; k<n; k++)
+            fTM[k] = griddiff(fM+k, k/nM, nT, nM);
+
+        for(i=0; i<nT-1; i++) {
+            for(j=0; j<nM-1; j++) {
+                /* Values, T derivatives, M derivatives, and cross derivatives
+                 * at the four corners */
+                for(q=0; q<2; q++) {
+                    for(r=0; r<2; r++) {
+                        k = (i+q)*nM + j+r;
+                        F[q][r] = f[k];
+                        F[q+2][r] = fT[k];
+                        F[q][r+2] = fM[k];
+                        F[q+2][r+2] = fTM[k];
+                    }
+                }
+
+                /* Coefficients are L*F*L^T */
+                for(q=0; q<4; q++) {
+                    for(r=0; r<4; r++) {
+                        LF[q][r] = 0;
+                        for(u=0; u<4; u++)
+                            LF[q][r] += L[q][u]*F[u][r];
+                    }
+                }
+                a = s->coef + 16*(CREEPNPARAM*(i*(nM-1)+j) + p);
+                for(q=0; q<4; q++) {
+                    for(r=0; r<4; r++) {
+                        a[4*q+r] = 0;
+                        for(u=0; u<4; u++)
+                            a[4*q+r] += LF[q][u]*L[r][u];
+                    }
+                }
+            }
+        }
+    }
+
+    free(f);
+    DestroyCSVTable(data);
+
+    return s;
+}
+
+/**
+ * Free a creep surface.
+ * @param s Surface to destroy
+ */
+void DestroyCreepSurface(creepsurface *s)
+{
+    free(s->coef);
+    free(s);
+}
+
+/**
+ * Find which cell of an evenly spaced grid a value is in.
+ * @param x Value to look up
+ * @param min First grid point
+ * @param dx Grid spacing
+ * @param n Number of grid points
+ * @param f Set to the position within the cell (0 to 1)
+ * @returns Index of the cell
+ */
+static int gridcell(double x, double min, double dx, int n, double *f)
+{
+    double p = (x - min)/dx;
+    int i;
+
+    if(p < 0)
+        p = 0;
+    if(p > n-1)
+        p = n-1;
+    i = (int) p;
+    if(i > n-2)
+        i = n-2;
+    *f = p - i;
+
+    return i;
+}
+
+/**
+ * Look up all of the creep parameters at a temperature and moisture content.
+ * Points outside the grid get the value at the nearest edge. This is O(1), so
+ * it can be used in place of fitting the creep function at each point.
+ * @param s Creep surface
+ * @param T Temperature [K]
+ * @param M Moisture content [kg/kg db]
+ * @param J0 Set to the instantaneous compliance
+ * @param J1 Set to the compliance of the first mode
+ * @param J2 Set to the compliance of the second mode
+ * @param tau1 Set to the retardation time of the first mode
+ * @param tau2 Set to the retardation time of the second mode
+ */
+void CreepSurfaceLookup(creepsurface *s, double T, double M, double *J0,
+                        double *J1, double *J2, double *tau1, double *tau2)
+{
+    double x, y, xp[4], yp[4], v[CREEPNPARAM], *a;
+    int i, j, p, q, r;
+
+    i = gridcell(T, s->Tmin, s->dT, s->nT, &x);
+    j = gridcell(M, s->Mmin, s->dM, s->nM, &y);
+
+    xp[0] = yp[0] = 1;
+    for(q=1; q<4; q++) {
+        xp[q] = xp[q-1]*x;
+        yp[q] = yp[q-1]*y;
+    }
+
+    a = s->coef + 16*CREEPNPARAM*(i*(s->nM-1)+j);
+    for(p=0; p<CREEPNPARAM; p++) {
+        v[p] = 0;
+        for(q=0; q<4; q++)
+            for(r=0; r<4; r++)
+                v[p] += a[16*p + 4*q+r]*xp[q]*yp[r];
+    }
+
+    /* Same column order as the csv file */
+    *J0 = v[0];
+    *J1 = v[1];
+    *tau1 = v[2];
+    *J2 = v[3];
+    *tau2 = v[4];
+}
+
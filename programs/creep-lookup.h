@@ -0,0 +1,39 @@
+#ifndef CREEP_LOOKUP_H
+#define CREEP_LOOKUP_H
+
+/**
+ * Table of creep compliance parameters at one temperature, as a function of
+ * moisture content. This is the output of creep-table loaded into memory.
+ */
+typedef struct {
+    int n; /* Number of rows */
+    double T, /* Temperature [K] */
+           *M, /* Moisture content [kg/kg db] */
+           *J0, *J1, *tau1, *J2, *tau2, /* Creep parameters */
+           Mmin, /* First moisture content */
+           dM; /* Spacing between rows, or 0 if the rows aren't evenly spaced */
+} creeptable;
+
+/**
+ * Creep compliance parameters over a grid of temperature and moisture content,
+ * stored as bicubic patches so they can be evaluated anywhere on the grid.
+ */
+typedef struct {
+    int nT, nM; /* Number of grid points in each direction */
+    double Tmin, dT, /* First temperature and spacing [K] */
+           Mmin, dM, /* First moisture content and spacing [kg/kg db] */
+           *coef; /* 16 coefficients per parameter per cell */
+} creepsurface;
+
+creeptable* LoadCreepTable(char*);
+void DestroyCreepTable(creeptable*);
+void CreepTableLookup(creeptable*, double,
+                      double*, double*, double*, double*, double*);
+
+creepsurface* LoadCreepSurface(char*);
+void DestroyCreepSurface(creepsurface*);
+void CreepSurfaceLookup(creepsurface*, double, double,
+                        double*, double*, double*, double*, double*);
+
+#endif
+
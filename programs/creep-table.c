@@ -1,39 +1,16 @@
 #include "matrix.h"
+#include "csv.h"
 #include "material-data.h"
 #include "regress.h"
+#include "pronymodel.h"
+#include "sample.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <unistd.h>
 
-double PronyModel(double t, matrix* beta, void *params)
-{
-    matrix *Ji, *taui;
-    double *p;
-    double J0, J, Jval, tauval;
-    int n, i;
-    p = (double*) params;
-    J0 = *p;
-
-    /* Pull out all the parameter values */
-    n = nRows(beta)/2;
-    Ji = CreateMatrix(n, 1);
-    taui = CreateMatrix(n, 1);
-
-    for(i=0; i<n; i++) {
-        setval(Ji, val(beta, 2*i, 0), i, 0);
-        setval(taui, val(beta, 2*i+1, 0), i, 0);
-    }
-
-    J = J0;
-    for(i=0; i<n; i++) {
-        Jval = val(Ji, i, 0)*val(Ji, i, 0);
-        tauval = val(taui, i, 0)*val(taui, i, 0);
-        J += Jval * (1-exp(-t/tauval));
-    }
-    DestroyMatrix(Ji);
-    DestroyMatrix(taui);
-    return J;
-}
+#define NLOGPTS 100 /* Number of log spaced points to fit */
+#define NADAPTMAX 200 /* Most points to use with adaptive sampling */
 
 matrix* makedata(matrix *t, double T, double M)
 {
@@ -65,41 +42,59 @@ matrix* fitdata(matrix *t, matrix *J)
            sqrt( .5*(Jt-J0) ),
            2, 0);
     setval(beta0, sqrt(200), 3, 0);
-    beta = fitnlmP(&PronyModel, t, J, beta0, &J0);
+    beta = fitnlmP(&PronyModelFixedJ0, t, J, beta0, &J0);
     DestroyMatrix(beta0);
     return beta;
 }
 
-int main(int argc, char *argv[])
+/**
+ * Creep function in the form needed by AdaptiveSample.
+ * @param t Time [s]
+ * @param params Array containing temperature [K] and moisture content
+ *      [kg/kg db]
+ * @returns Creep compliance
+ */
+static double creepfunc(double t, void *params)
 {
-    int i, j;
-    double T, Mi, percent;
-    vector *M;
-    matrix *t, *Ji, *betai, *output, *ttmp;
-    char* outfile;
-
-    if(argc != 2) {
-        printf("Usage:\n"
-               "creep-table: <T>\n"
-               "<T>: Temperature to generate values at. (K)\n");
-        exit(0);
-    }
-
-    T = atof(argv[1]);
-    M = linspaceV(.005, .5, 1000);
-
-    ttmp = linspace(1e-3, 1e3, 1000);
-    t = mtxtrn(ttmp);
-    DestroyMatrix(ttmp);
+    double *TM = (double*) params;
+    return LLauraCreep(t, TM[0], TM[1], 0);
+}
 
-    output = CreateMatrix(len(M), 2+5);
+/**
+ * Fit the creep function at every combination of temperature and moisture
+ * content. Each point is fit independently, so they are split up between
+ * threads.
+ * @param T Vector of temperatures [K]
+ * @param M Vector of moisture contents [kg/kg db]
+ * @param t Column matrix of times to fit the creep function over [s]
+ * @param tol If positive, ignore t and choose the times separately for each
+ *      point so that interpolating between them is accurate to within tol
+ *      (see AdaptiveSample).
+ * @returns Matrix with one row for each (T, M) pair, ordered by temperature
+ *      and then moisture content, with the columns T, M, J0, J1, tau1, J2,
+ *      and tau2
+ */
+matrix* fitgrid(vector *T, vector *M, matrix *t, double tol)
+{
+    matrix *output, *Ji, *betai, *ti;
+    double Ti, Mi, TM[2];
+    int i, j, n = len(T)*len(M), done = 0;
 
-    for(i=0; i<len(M); i++) {
-        Mi = valV(M, i);
-        Ji = makedata(t, T, Mi);
-        betai = fitdata(t, Ji);
+    output = CreateMatrix(n, 2+5);
 
-        setval(output, T, i, 0);
+#pragma omp parallel for schedule(dynamic) private(Ti, Mi, TM, Ji, betai, ti, j)
+    for(i=0; i<n; i++) {
+        Ti = valV(T, i/len(M));
+        Mi = valV(M, i%len(M));
+        TM[0] = Ti;
+        TM[1] = Mi;
+        ti = (tol > 0) ? AdaptiveSample(&creepfunc, TM, 1e-3, 1e3, tol, NADAPTMAX) : t;
+        Ji = makedata(ti, Ti, Mi);
+        betai = fitdata(ti, Ji);
+        if(ti != t)
+            DestroyMatrix(ti);
+
+        setval(output, Ti, i, 0);
         setval(output, Mi, i, 1);
         setval(output, val(Ji, 0, 0), i, 2);
         for(j=0; j<nRows(betai); j++)
@@ -108,16 +103,89 @@ int main(int argc, char *argv[])
         DestroyMatrix(betai);
 
         /* Print the percent done */
-        percent = (1.*i)/len(M)*100.;
-        printf("%3.2f %%\r", percent);
-        fflush(stdout);
+#pragma omp critical(progress)
+        {
+            done++;
+            printf("%3.2f %%\r", (1.*done)/n*100.);
+            fflush(stdout);
+        }
     }
-    
+
+    return output;
+}
+
+int main(int argc, char *argv[])
+{
+    vector *T, *M;
+    matrix *t, *output, *ttmp;
+    char* outfile;
+    int n, c,
+        uniform = 0; /* Use 1000 evenly spaced points */
+    double tol = 0; /* Tolerance for adaptive sampling */
+
+    while((c = getopt(argc, argv, "ua:")) != -1) {
+        switch(c) {
+            case 'u':
+                uniform = 1;
+                break;
+            case 'a':
+                tol = atof(optarg);
+                break;
+            default:
+                exit(1);
+        }
+    }
+    argc -= optind-1;
+    argv += optind-1;
+
+    if(argc != 2 && argc != 7) {
+        printf("Usage:\n"
+               "creep-table: [-u] [-a <tol>] <T>\n"
+               "creep-table: [-u] [-a <tol>] <Tmin> <Tmax> <nT> <Mmin> <Mmax> <nM>\n"
+               "<T>: Temperature to generate values at. (K)\n"
+               "<Tmin> <Tmax> <nT>: Range and number of temperatures for a\n"
+               "\ttable over both temperature and moisture content. (K)\n"
+               "<Mmin> <Mmax> <nM>: Range and number of moisture contents.\n"
+               "\t(kg/kg db)\n"
+               "-u: Fit 1000 evenly spaced points instead of %d log spaced ones.\n"
+               "-a: Choose the points for each fit so that interpolating\n"
+               "\tbetween them is accurate to within tol (relative).\n", NLOGPTS);
+        exit(0);
+    }
+
+    if(argc == 2) {
+        T = CreateVector(1);
+        setvalV(T, 0, atof(argv[1]));
+        M = linspaceV(.005, .5, 1000);
+    } else {
+        T = linspaceV(atof(argv[1]), atof(argv[2]), atoi(argv[3]));
+        M = linspaceV(atof(argv[4]), atof(argv[5]), atoi(argv[6]));
+    }
+
+    if(uniform) {
+        ttmp = linspace(1e-3, 1e3, 1000);
+        t = mtxtrn(ttmp);
+        DestroyMatrix(ttmp);
+    } else {
+        t = logspacecol(1e-3, 1e3, NLOGPTS);
+    }
+
+    output = fitgrid(T, M, t, tol);
+
+    if(argc == 2) {
+        n = snprintf(NULL, 0, "creep-%gK.csv", valV(T, 0));
+        outfile = (char*) calloc(sizeof(char), n+1);
+        sprintf(outfile, "creep-%gK.csv", valV(T, 0));
+    } else {
+        n = snprintf(NULL, 0, "creep-%g-%gK.csv", valV(T, 0), valV(T, len(T)-1));
+        outfile = (char*) calloc(sizeof(char), n+1);
+        sprintf(outfile, "creep-%g-%gK.csv", valV(T, 0), valV(T, len(T)-1));
+    }
+
     DestroyMatrix(t);
+    DestroyVector(T);
     DestroyVector(M);
-    outfile = (char*) calloc(sizeof(char), 20);
-    sprintf(outfile, "creep-%gK.csv", T);
-    mtxprntfilehdr(output, outfile, "T,M,J0,J1,tau1,J2,tau2\n");
+    csvprntfilehdr(output, outfile, "T,M,J0,J1,tau1,J2,tau2\n", 0);
     DestroyMatrix(output);
     free(outfile);
     return 0;
@@ -8,20 +8,42 @@
 #include "regress.h"
 
 #include "matrix.h"
+#include "csv.h"
 
 #include "material-data.h"
 
+/**
+ * Wrapper around AchantaDiffModel for fitnlmM. The model from material-data
+ * takes the x values as a 1x2 matrix, so copy the row into a scratch matrix
+ * that is kept around between calls.
+ * @param x View of one row of the data matrix (Xdb, T)
+ * @param beta Fitting parameters
+ * @returns Effective diffusivity [m^2/s]
+ */
+double AchantaDiffRow(mtxrow *x, matrix *beta)
+{
+    static matrix *xi = NULL;
+
+    if(!xi)
+        xi = CreateMatrix(1, 2);
+    setval(xi, rowval(x, 0), 0, 0);
+    setval(xi, rowval(x, 1), 0, 1);
+
+    return AchantaDiffModel(xi, beta);
+}
+
 /**
  * Load in a data file and calculate tortuosity.
  */
 int main(int argc, char *argv[])
 {
     int i;
-    matrix *data, *X, *y, *beta0, *beta;
-    vector *T, *Xdb;
+    csvtable *data;
+    matrix *X, *y, *beta0, *beta;
     int xdbcol = 0, /* Column for Xdb */
         tempcol = 1, /* Temperature column */
-        deffcol = 2; /* Effective diffusivity column */
+        deffcol = 2, /* Effective diffusivity column */
+        Xcols[] = {xdbcol, tempcol}; /* Independent variables */
 
     /* If a filename isn't supplied, spit out usage info and exit */
     if(argc != 2) {
@@ -30,20 +52,22 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    /* Load the csv file into a matrix */
-    data = mtxloadcsv(argv[1], 1);
+    /* Load the csv file */
+    data = CSVLoad(argv[1], 1);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
 
     /* Pull out the relevant data */
-    T = ExtractColumnAsVector(data, tempcol);
-    Xdb = ExtractColumnAsVector(data, xdbcol);
-    y = ExtractColumn(data, deffcol);
+    X = CSVTableMatrix(data, Xcols, 2);
+    y = CSVColumnMatrix(data, deffcol);
+    DestroyCSVTable(data);
     beta0 = ParseMatrix("[1.78e-5;36543.88;1e-10]");
     for(i=0; i<nRows(beta0); i++)
         setval(beta0, sqrt(val(beta0, i, 0)), i, 0);
 
-    X = CatColVector(2, Xdb, T);
-
-    beta = fitnlmM(&AchantaDiffModel, X, y, beta0);
+    beta = fitnlmM(&AchantaDiffRow, X, y, beta0);
 
     printf("D0: %g\nEa: %g\nD1: %g\nD2: %g\n",
             pow(val(beta, 0, 0), 2),
@@ -53,13 +77,9 @@ int main(int argc, char *argv[])
 
     DestroyMatrix(beta);
     DestroyMatrix(beta0);
-    DestroyMatrix(data);
     DestroyMatrix(X);
     DestroyMatrix(y);
 
-    DestroyVector(T);
-    DestroyVector(Xdb);
-
     return 0;
 }
 
@@ -8,6 +8,7 @@
 #include "regress.h"
 
 #include "matrix.h"
+#include "csv.h"
 
 #include "diffusivity.h"
 #include "constants.h"
@@ -21,7 +22,7 @@
  * @param beta A 1x1 matrix containing the value of tau (tortuosity) [-]
  * @returns effective diffusivity
  */
-double CreepModel(matrix *x, matrix *beta)
+double CreepModel(mtxrow *x, matrix *beta)
 {
     double aM, aP, xi, J;
     double J0 = val(beta, 0, 0),
@@ -35,9 +36,9 @@ double CreepModel(matrix *x, matrix *beta)
            aP0 = val(beta, 8, 0),
            P0 = val(beta, 9, 0),
 
-           t = val(x, 0, 0),
-           M = val(x, 0, 1),
-           P = val(x, 0, 2);
+           t = rowval(x, 0),
+           M = rowval(x, 1),
+           P = rowval(x, 2);
 
     aM = exp(aM0*(M-M0));
     aP = exp(aP0*(P-P0));
@@ -53,12 +54,13 @@ double CreepModel(matrix *x, matrix *beta)
  */
 int main(int argc, char *argv[])
 {
-    matrix *data, *X, *y, *beta0, *beta;
-    vector *t, *Xdb, *P;
+    csvtable *data;
+    matrix *X, *y, *beta0, *beta;
     int tcol = 0, /* Column to get time from */
         xdbcol = 1, /* Column for Xdb */
         pcol = 2, /* Pressure column */
-        jcol = 3; /* Creep compliance column */
+        jcol = 3, /* Creep compliance column */
+        Xcols[] = {tcol, xdbcol, pcol}; /* Independent variables */
 
     /* If a filename isn't supplied, spit out usage info and exit */
     if(argc != 2) {
@@ -67,18 +69,19 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    /* Load the csv file into a matrix */
-    data = mtxloadcsv(argv[1], 0);
+    /* Load the csv file */
+    data = CSVLoad(argv[1], 0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
 
     /* Pull out the relevant data */
-    t = ExtractColumnAsVector(data, tcol);
-    Xdb = ExtractColumnAsVector(data, xdbcol);
-    P = ExtractColumnAsVector(data, pcol);
-    y = ExtractColumn(data, jcol);
+    X = CSVTableMatrix(data, Xcols, 3);
+    y = CSVColumnMatrix(data, jcol);
+    DestroyCSVTable(data);
     beta0 = ParseMatrix("[1.63e-6;1.45e-7;1.56e-7;2.282;25.78;1.42e9;-73;.14;1;2e5]");
 
-    X = CatColVector(3, t, Xdb, P);
-
     beta = fitnlmM(&CreepModel, X, y, beta0);
     mtxprnt(beta);
 
@@ -1,4 +1,5 @@
 #include "matrix.h"
+#include "csv.h"
 #include "regress.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -6,7 +7,8 @@
 
 int main(int argc, char *argv[])
 {
-    matrix *input, *X, *y, *b;
+    csvtable *input;
+    matrix *X, *y, *b;
     vector *J, *tau;
     int i, j;
     double ti;
@@ -24,18 +26,22 @@ int main(int argc, char *argv[])
 
     /* The first row should probably be a header, and the second one might be
      * junk as well. */
-    input = mtxloadcsv(argv[1], 2);
+    input = CSVLoad(argv[1], 2);
+    if(!input) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        exit(1);
+    }
 
     tau = CreateVector(argc-2);
     J = CreateVector(argc-2);
     for(i=2; i<argc; i++)
         setvalV(tau, i-2, atof(argv[i]));
 
-    y = ExtractColumn(input, 1);
-    X = CreateMatrix(nRows(input), argc-1);
+    y = CSVColumnMatrix(input, 1);
+    X = CreateMatrix(input->nrows, argc-1);
 
-    for(i=0; i<nRows(input); i++) {
-        ti = val(input, i, 0);
+    for(i=0; i<input->nrows; i++) {
+        ti = csvval(input, i, 0);
         setval(X, 1, i, 0);
         for(j=0; j<len(tau); j++)
             setval(X, 1-exp(-ti/valV(tau, j)), i, j+1);
@@ -48,7 +54,7 @@ int main(int argc, char *argv[])
     PrintVector(tau);
     PrintVector(J);
 
-    DestroyMatrix(input);
+    DestroyCSVTable(input);
     DestroyMatrix(y);
     DestroyMatrix(X);
     DestroyMatrix(b);
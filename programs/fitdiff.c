@@ -9,11 +9,63 @@
 #include <math.h>
 
 #include "regress.h"
+#include "proptable.h"
 
 #include "matrix.h"
+#include "csv.h"
 
 #include "material-data.h"
 
+#define EBXMIN 1e-2 /* Smallest moisture content to tabulate [kg/kg db] */
+#define EBXMAX 1 /* Largest moisture content to tabulate [kg/kg db] */
+#define EBTOL 1e-6 /* Relative accuracy of the binding energy table */
+
+/**
+ * Oswin isotherm parameters. These are only loaded once.
+ * @returns Isotherm data
+ */
+static oswin* OswinData()
+{
+    static oswin *dat = NULL;
+    if(!dat)
+        dat = OSWINDATA();
+    return dat;
+}
+
+/**
+ * Binding energy as a function of moisture content only, for use with
+ * CreatePropTable.
+ * @param Xdb Moisture content [kg/kg db]
+ * @param T Pointer to the temperature [K]
+ * @returns Binding energy [J/mol]
+ */
+static double BindingEnergyX(double Xdb, void *T)
+{
+    return BindingEnergyOswin(OswinData(), Xdb, *((double*) T));
+}
+
+/**
+ * Same as BindingEnergyOswin, but using a table that is made the first time
+ * it is needed. The table is remade if the temperature changes.
+ * @param Xdb Moisture content [kg/kg db]
+ * @param T Temperature [K]
+ * @returns Binding energy [J/mol]
+ */
+static double BindingEnergy(double Xdb, double T)
+{
+    static proptable *Eb = NULL;
+    static double TEb; /* Temperature the table was made at */
+
+    if(!Eb || TEb != T) {
+        if(Eb)
+            DestroyPropTable(Eb);
+        TEb = T;
+        Eb = CreatePropTable(&BindingEnergyX, &TEb, EBXMIN, EBXMAX, EBTOL);
+    }
+
+    return PropTableVal(Eb, Xdb);
+}
+
 /**
  * Modified version of the diffusion model from the Handbook of Food
  * Engineering.
@@ -24,16 +76,13 @@
  */
 double DiffModel(double Xdb, matrix *beta)
 {
-    oswin *dat;
-    dat = OSWINDATA();
-
     double Deff,
            T = 55+273.15, /* Temperature [K] */
            Dself = SelfDiffWater(T),
            phi = POROSITY,
            tau = val(beta, 0, 0),
            K = 1032.558, /* Source: Xiong et al. (1991) */
-           Eb = BindingEnergyOswin(dat, Xdb, T),
+           Eb = BindingEnergy(Xdb, T),
            R = 8.314; /* Gas Constant */
 
 
@@ -52,13 +101,10 @@ double DiffModel(double Xdb, matrix *beta)
  */
 double CalcX(double Xdb, double T)
 {
-    oswin *dat;
-    dat = OSWINDATA();
-
     double X,
            Dself = SelfDiffWater(T),
            K = 1032.558, /* Source: Xiong et al. (1991) */
-           Eb = BindingEnergyOswin(dat, Xdb, T),
+           Eb = BindingEnergy(Xdb, T),
            R = 8.314; /* Gas Constant */
 
 
@@ -73,7 +119,8 @@ double CalcX(double Xdb, double T)
  */
 int main(int argc, char *argv[])
 {
-    matrix *data, *Xdb, *D, *beta, *X;
+    csvtable *data;
+    matrix *Xdb, *D, *beta, *X;
     int dcol = 1, /* Column to get diffusivity from */
         xdbcol = 0, /* Column for Xdb */
         i;
@@ -86,12 +133,17 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    /* Load the csv file into a matrix */
-    data = mtxloadcsv(argv[1], 0);
+    /* Load the csv file */
+    data = CSVLoad(argv[1], 0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
 
     /* Pull out the relevant data */
-    Xdb = ExtractColumn(data, xdbcol);
-    D = ExtractColumn(data, dcol);
+    Xdb = CSVColumnMatrix(data, xdbcol);
+    D = CSVColumnMatrix(data, dcol);
+    DestroyCSVTable(data);
     //beta0 = CreateMatrix(1, 1);
 
     X = CreateMatrix(nRows(D), 1);
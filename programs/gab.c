@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include "matrix.h"
+#include "csv.h"
 #include "regress.h"
 
 /**
@@ -36,32 +37,32 @@ double gab(double aw, matrix* beta)
  */
 int main(int argc, char *argv[])
 {
-    matrix *data, *aw, *Xdb, *tmp0, *tmp1, *beta0, *beta;
+    csvtable *data;
+    matrix *aw, *Xdb, *beta0, *beta;
+    int awcol = 0, /* Water activity column */
+        Xdbcol = 5, /* Moisture content column */
+        cols[] = {awcol, Xdbcol};
 
     if(argc != 2) {
         puts("Usage:");
         puts("gab <aw.csv>");
+        return 0;
+    }
+    //data = CSVLoad("Andrieu.csv", 0);
+    data = CSVLoad(argv[1], 0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
     }
-    //data = mtxloadcsv("Andrieu.csv", 0);
-    data = mtxloadcsv(argv[1], 0);
-
-    /* Get the water activity from column 1 and the moisture content from
-     * column 6. */
-    aw = ExtractColumn(data, 0);
-    Xdb = ExtractColumn(data, 5);
 
-    /* Stick the two matricies together and delete any rows that contain
-     * empty values */
-    tmp0 = AugmentMatrix(aw, Xdb);
-    tmp1 = DeleteNaNRows(tmp0);
-    DestroyMatrix(aw);
-    DestroyMatrix(Xdb);
+    /* Delete any rows that are missing either the water activity (column 1)
+     * or the moisture content (column 6) */
+    CSVDeleteNaNRows(data, cols, 2);
 
-    /* Pull the two columns back apart */
-    aw = ExtractColumn(tmp1, 0);
-    Xdb = ExtractColumn(tmp1, 1);
-    DestroyMatrix(tmp0);
-    DestroyMatrix(tmp1);
+    /* Pull out the two columns */
+    aw = CSVColumnMatrix(data, awcol);
+    Xdb = CSVColumnMatrix(data, Xdbcol);
+    DestroyCSVTable(data);
 
     /* Set up the beta matrix with some initial guesses at the GAB constants.
      * The solver needs these to be pretty close to the actual values, or it
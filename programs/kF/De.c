@@ -59,6 +59,7 @@ int FindInitialPointRH(vector *RH)
  * @param kF Vector of kF values [1/s]
  * @param L0 Initial slab thickness (full thickness) [m]
  * @param T Temperature (assumed constant) [K]
+ * @param Dtab Diffusivity table for T (see DiffCh10Table), or NULL
  * @param m Set of Maxwell parameters used for determining mean relaxation time.
  * @returns Deborah number [-]
  */
@@ -68,6 +69,7 @@ double DeborahNumber(int initial,
                      vector *kF,
                      double L0,
                      double T,
+                     proptable *Dtab,
                      maxwell* m)
 {
     double Dkf0, /* Diffusivity at t=0 (calculated from kF values) */
@@ -92,8 +94,8 @@ double DeborahNumber(int initial,
 
     /* Calculate diffusivities */
     Dkf0 = kf0*L0*L0/(M_PI*M_PI);
-    D0 = DiffCh10(Xdb0, T);
-    Di = DiffCh10(Xdbi, T);
+    D0 = DiffCh10Tab(Dtab, Xdb0, T);
+    Di = DiffCh10Tab(Dtab, Xdbi, T);
 
     /* Normalize the model diffusivity based on the initial diffusivity from the
      * kF value */
@@ -128,6 +130,7 @@ vector* DeborahMatrix(int initial,
                       maxwell* m)
 {
     int i;
+    proptable *Dtab = DiffCh10Table(T); /* Diffusivity table */
 
     vector* De;
 
@@ -135,7 +138,7 @@ vector* DeborahMatrix(int initial,
     for(i=0; i<initial; i++)
         setvalV(De, i, 0);
     for(i=initial; i<len(De); i++)
-        setvalV(De, i, DeborahNumber(initial, i, Xdb, kF, L0, T, m));
+        setvalV(De, i, DeborahNumber(initial, i, Xdb, kF, L0, T, Dtab, m));
 
     return De;
 }
@@ -147,6 +150,12 @@ vector* DOswinVector(int initial, vector *X, double T)
 {
     int i;
     vector *D;
+    proptable *p;
+
+    p = DiffCh10Table(T);
+    if(p)
+        return PropTableVector(p, X);
+
     D = CreateVector(len(X));
     for(i=0; i<len(X); i++)
         setvalV(D, i, DiffCh10(valV(X, i), T));
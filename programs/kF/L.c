@@ -17,6 +17,7 @@
  * @param kF Vector of kF values [1/s]
  * @param L0 Initial length [m]
  * @param T Temperature (assumed constant) [K]
+ * @param Dtab Diffusivity table for T (see DiffCh10Table), or NULL
  * @returns Thickness [-]
  */
 double NewLength(int initial,
@@ -24,7 +25,8 @@ double NewLength(int initial,
                  vector *Xdb,
                  vector *kF,
                  double L0,
-                 double T)
+                 double T,
+                 proptable *Dtab)
 {
     double Dkf0, /* Diffusivity at t=0 (calculated from kF values) */
            D0, /* Diffusivity at t=0 (calculated from model) */
@@ -46,8 +48,8 @@ double NewLength(int initial,
 
     /* Calculate diffusivities */
     Dkf0 = kf0*L0*L0/(M_PI*M_PI);
-    D0 = DiffCh10(Xdb0, T);
-    Di = DiffCh10(Xdbi, T);
+    D0 = DiffCh10Tab(Dtab, Xdb0, T);
+    Di = DiffCh10Tab(Dtab, Xdbi, T);
 
     /* Normalize the model diffusivity based on the initial diffusivity from the
      * kF value */
@@ -75,6 +77,7 @@ vector* LengthMatrix(int initial,
                      double T)
 {
     int i;
+    proptable *Dtab = DiffCh10Table(T); /* Diffusivity table */
 
     vector *L;
 
@@ -82,7 +85,7 @@ vector* LengthMatrix(int initial,
     for(i=0; i<initial; i++)
         setvalV(L, i, L0);
     for(i=initial; i<len(L); i++)
-        setvalV(L, i, NewLength(initial, i, Xdb, kF, L0, T));
+        setvalV(L, i, NewLength(initial, i, Xdb, kF, L0, T, Dtab));
 
     return L;
 }
@@ -178,29 +181,20 @@ vector* LengthDensityChange(int initial,
                             double Mdry,
                             double T)
 {
-    double Xdbi, /* Individual moisture content values */
-           rho0, rhoi,
-           X0 = valV(Xdb, initial); /* Initial moisture content */
+    double rho0; /* Density at the initial point */
     int i; /* Loop index */
-    choi_okos *codry, *co0, *coi; /* Choi-okos values for water density */
+    pastadensity *d; /* Density at the drying temperature */
     vector *L; /* Calculated matrix of thicknesses */
 
-    codry = CreateChoiOkos(PASTACOMP);
-    L = CreateVector(len(Xdb));
-    co0 = AddDryBasis(codry, X0);
-    rho0 = rho(co0, T);
-    DestroyChoiOkos(co0);
+    d = CreatePastaDensity(PASTACOMP, T);
+    rho0 = PastaDensity(d, valV(Xdb, initial));
 
-    for(i=0; i<len(Xdb); i++) {
-        Xdbi = valV(Xdb, i);
-        coi = AddDryBasis(codry, Xdbi);
-        rhoi = rho(coi, T);
-        DestroyChoiOkos(coi);
-
-        setvalV(L, i, rho0/rhoi * L0);
-    }
+    /* Start with the density at each point, then convert to thickness */
+    L = PastaDensityVector(d, Xdb);
+    for(i=0; i<len(L); i++)
+        setvalV(L, i, rho0/valV(L, i) * L0);
 
-    DestroyChoiOkos(codry);
+    DestroyPastaDensity(d);
     
     return L;
 }
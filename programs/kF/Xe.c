@@ -175,136 +175,163 @@ double NCalcXe(int initial, vector *t, vector *Xdb, double Xe0)
 }
 
 /**
- * Calculate the equilibrium moisture content. This algorithm takes an initial
- * guess for Xe and then fits a linear equation to
- * \f$\ln\frac{X-X_e}{X_0-X_e}\f$ vs. \f$ t\f$. It then determines the \f$R^2\f$
- * value for that set of coefficients and then iteratively improves the fit
- * using Newton's method.
+ * Calculate the \f$R^2\f$ value for the fit of
+ * \f$y = \ln\frac{X-X_e}{X_0-X_e}\f$ vs. \f$t\f$ to a line through the
+ * origin, along with its first and second derivatives with respect to Xe. For a
+ * line through the origin, the slope is \f$\sum ty/\sum t^2\f$, and
+ * \f[
+ * R^2 = 1 - \frac{\sum y^2 - (\sum ty)^2/\sum t^2}{\sum y^2 - (\sum y)^2/n}
+ * \f]
+ * so everything can be calculated from a few sums, and the derivatives follow
+ * from differentiating those sums term by term. All of it is done in a single
+ * pass through the data. If the data has been decimated, each term is
+ * weighted by the number of original rows the point stands for, and n is the
+ * sum of the weights.
  * @param initial Row number of the first data point to use
  * @param t Vector of time values [s]
  * @param Xdb Vector of moisture contents [kg/kg db]
+ * @param w Weight of each point (see DecimateWeights), or NULL to weight
+ *      them all equally
+ * @param Xe Equilibrium moisture content [kg/kg db]. This must be less than
+ *      all of the moisture content values used.
+ * @param dR Set to the first derivative of R^2 with respect to Xe
+ * @param d2R Set to the second derivative of R^2 with respect to Xe
+ * @param slope Set to the slope of the fitted line (-kF). May be NULL.
+ * @returns \f$R^2\f$
+ *
+ * @see CalcXeIt rsquared
+ */
+double XeRSquared(int initial, vector *t, vector *Xdb, vector *w, double Xe,
+                  double *dR, double *d2R, double *slope)
+{
+    int i; /* Loop index */
+    double n = 0, /* Number of points (or sum of the weights) */
+           wi = 1, /* Weight of the current point */
+           r0 = 1/(valV(Xdb, initial) - Xe), /* 1/(X0-Xe) */
+           ti, ri, /* Time since the initial point and 1/(Xi-Xe) */
+           y, dy, d2y, /* y at each point and its derivatives */
+           Stt = 0, /* Sum of t^2 */
+           Sy = 0, Sdy = 0, Sd2y = 0, /* Sum of y and its derivatives */
+           Sty = 0, Stdy = 0, Std2y = 0, /* Sum of t*y and its derivatives */
+           Syy = 0, Sdyy = 0, Sd2yy = 0, /* Sum of y^2 and its derivatives */
+           SSres, dSSres, d2SSres, /* Residual sum of squares */
+           SStot, dSStot, d2SStot, /* Total sum of squares */
+           N, dN; /* Numerator of dR/dXe, and its derivative */
+
+    for(i=initial; i<len(Xdb); i++) {
+        ti = valV(t, i) - valV(t, initial);
+        ri = 1/(valV(Xdb, i) - Xe);
+        if(w)
+            wi = valV(w, i);
+
+        y = log(r0/ri);
+        dy = r0 - ri;
+        d2y = r0*r0 - ri*ri;
+
+        n += wi;
+        Stt += wi*ti*ti;
+        Sy += wi*y;
+        Sdy += wi*dy;
+        Sd2y += wi*d2y;
+        Sty += wi*ti*y;
+        Stdy += wi*ti*dy;
+        Std2y += wi*ti*d2y;
+        Syy += wi*y*y;
+        Sdyy += wi*2*y*dy;
+        Sd2yy += wi*2*(dy*dy + y*d2y);
+    }
+
+    SSres = Syy - Sty*Sty/Stt;
+    dSSres = Sdyy - 2*Sty*Stdy/Stt;
+    d2SSres = Sd2yy - 2*(Stdy*Stdy + Sty*Std2y)/Stt;
+
+    SStot = Syy - Sy*Sy/n;
+    dSStot = Sdyy - 2*Sy*Sdy/n;
+    d2SStot = Sd2yy - 2*(Sdy*Sdy + Sy*Sd2y)/n;
+
+    /* R^2 = 1 - SSres/SStot */
+    N = dSSres*SStot - SSres*dSStot;
+    dN = d2SSres*SStot - SSres*d2SStot;
+    *dR = -N/(SStot*SStot);
+    *d2R = -dN/(SStot*SStot) + 2*N*dSStot/(SStot*SStot*SStot);
+
+    if(slope)
+        *slope = Sty/Stt;
+
+    return 1 - SSres/SStot;
+}
+
+/**
+ * Calculate the equilibrium moisture content. This algorithm finds the value
+ * of Xe that makes a plot of \f$\ln\frac{X-X_e}{X_0-X_e}\f$ vs. \f$ t\f$
+ * as close to linear as possible by maximizing the \f$R^2\f$ value of a
+ * line through the origin. The maximum is found using Newton's method on
+ * \f$dR^2/dX_e\f$, with the derivatives calculated analytically by
+ * XeRSquared. The method is safeguarded by a bracket: Xe has to be between zero
+ * and the smallest moisture content in the data, and any Newton step that
+ * leaves the bracket (or heads toward a minimum) is replaced by bisection.
+ * @param initial Row number of the first data point to use
+ * @param t Vector of time values [s]
+ * @param Xdb Vector of moisture contents [kg/kg db]
+ * @param w Weight of each point (see XeRSquared), or NULL
  * @param Xe0 Initial guess for equilibrium moisture content [kg/kg db]
  * @returns Equilibrium moisture content [kg/kg db]
  *
- * @see regress
+ * @see XeRSquared
  */
-double CalcXeIt(int initial, vector *t, vector *Xdb, double Xe0)
+double CalcXeIt(int initial, vector *t, vector *Xdb, vector *w, double Xe0)
 {
     int iter = 0, /* Keep track of the number of iterations */
+        maxiter = 100, /* Maximum number of iterations allowed */
         i; /* Loop index */
-    double Xinit, /* Initial moisture content */
-           Xe, /* Current guess for Xe */
+    double Xe, /* Current guess for Xe */
            Xep, /* Previous guess for Xe */
+           Xmin, /* Smallest moisture content in the data */
+           lo, hi, /* Bracket containing the best value of Xe */
            dR, /* First derivative of R^2 with respect to Xe */
            d2R, /* Second derivative of R^2 */
            kF,
-           tol = 1e-7, /* How close Xe and Xep need to be before we stop */
-           h = 1e-7, /* Used for numerical differentiation */
-           m = 2; /* Used to increase the rate of convergence */
-    matrix *beta, /* Beta value from regress */
-           *beta_ph, /* Same, but calculated at Xe + h */
-           *beta_mh, /* Beta at Xe - h */
-           *tmp_ph, /* Same as beta_ph, but with an extra zero to make rsquared
-                       happy */
-           *tmp,
-           *tmp_mh,
-           *y, /* y values */
-           *yph, /* Same as y, but at Xe + h */
-           *ymh, /* y at Xe - h */
-           *tadj, /* New matrix of t values that starts at the initial row */
-           *Xadj; /* Same as tadj, but for Xdb */
+           tol = 1e-7; /* How close Xe and Xep need to be before we stop */
 
-    /* Set the initial moisture content */
-    Xinit = valV(Xdb, initial);
-    /* Set the first value of Xe to Xe0 */
-    Xe = Xe0;
+    /* Xe has to be less than every moisture content value, or the log is
+     * undefined. */
+    Xmin = valV(Xdb, initial);
+    for(i=initial; i<len(Xdb); i++)
+        if(valV(Xdb, i) < Xmin)
+            Xmin = valV(Xdb, i);
+    hi = Xmin - tol;
+    lo = (hi > 0) ? 0 : hi - (valV(Xdb, initial) - Xmin);
 
-    /* Make smaller matricies that contain only the "good" data. */
-    tadj = CreateMatrix(len(t) - initial, 1);
-    Xadj = CreateMatrix(len(Xdb) - initial, 1);
-    for(i=initial; i<len(t); i++) {
-        /* In addition to just copying the data, subtract the initial time from
-         * each value to make sure that the intercept for the model goes through
-         * the origin */
-        setval(tadj, valV(t, i)-valV(t, initial), i-initial, 0);
-        setval(Xadj, valV(Xdb, i), i-initial, 0);
-    }
+    /* Start from the initial guess if it's inside the bracket */
+    Xe = (Xe0 > lo && Xe0 < hi) ? Xe0 : (lo+hi)/2;
 
     /* Actually find Xe */
     do {
-        /* Make a y matrix containing ln((Xdb - Xe)/(X0-Xe)) */
-        y = CreateMatrix(nRows(Xadj), 1);
-        for(i=0; i<nRows(Xadj); i++)
-            setval(y, log((val(Xadj, i, 0) - Xe)/(Xinit - Xe)), i, 0);
-        /* Calculate the kf parameter */
-        beta = regress(y, tadj);
+        XeRSquared(initial, t, Xdb, w, Xe, &dR, &d2R, &kF);
 
-        /* Do the same, but at Xe - h */
-        ymh = CreateMatrix(nRows(Xadj), 1);
-        for(i=0; i<nRows(Xadj); i++)
-            setval(ymh, log((val(Xadj, i, 0) - Xe-h)/(Xinit - Xe-h)), i, 0);
-        beta_ph = regress(ymh, tadj);
-
-        /* At Xe + h */
-        yph= CreateMatrix(nRows(Xadj), 1);
-        for(i=0; i<nRows(Xadj); i++)
-            setval(yph, log((val(Xadj, i, 0) - Xe+h)/(Xinit - Xe+h)), i, 0);
-        beta_mh = regress(yph, tadj);
-
-        /* Add in a constant parameter of zero to the beta matrix. Do this for
-         * each of the beta matricies we've got. */
-        tmp_ph = CreateMatrix(2,1);
-        setval(tmp_ph, 0, 0, 0);
-        setval(tmp_ph, val(beta_ph, 0, 0), 1, 0);
-
-        tmp = CreateMatrix(2,1);
-        setval(tmp, 0, 0, 0);
-        setval(tmp, val(beta, 0, 0), 1, 0);
-
-        tmp_mh = CreateMatrix(2,1);
-        setval(tmp_mh, 0, 0, 0);
-        setval(tmp_mh, val(beta_mh, 0, 0), 1, 0);
+        /* Shrink the bracket toward the maximum */
+        if(dR > 0)
+            lo = Xe;
+        else
+            hi = Xe;
 
-        /* Calculate f and df */
-        dR = (rsquared(tadj, yph, tmp_ph) - rsquared(tadj, ymh, tmp_mh))/(2*h);
-        d2R = (rsquared(tadj, yph, tmp_ph) - 2*rsquared(tadj, y, tmp) + rsquared(tadj, ymh, tmp_mh))/(h*h);
-        if(d2R == 0) {
-            printf("Terminating due to division by zero.\n");
-            break;
-        }
-
-        /* Calculate the new value of Xe */
+        /* Take a Newton step if it stays inside the bracket and is headed
+         * toward a maximum. Otherwise, bisect. */
         Xep = Xe;
-        Xe = Xep + m*dR/d2R;
-
-        kF = val(tmp, 1, 0);
-
-        /* Clean up */
-        DestroyMatrix(y);
-        DestroyMatrix(yph);
-        DestroyMatrix(ymh);
-        DestroyMatrix(beta);
-        DestroyMatrix(tmp_ph);
-        DestroyMatrix(tmp);
-        DestroyMatrix(tmp_mh);
+        Xe = Xep - dR/d2R;
+        if(!(d2R < 0) || !(Xe > lo && Xe < hi))
+            Xe = (lo+hi)/2;
 
         /* Keep track of how many iterations we've gone through */
         iter++;
-
-        /* Print out the current value */
-        printf("Xe = %g\r", Xe);
-
-        /* If Xe ever goes negative, admit defeat. */
-        if(Xe < 0) {
-            printf("Failure to converge after %d iterations.\n", iter);
-            return Xe;
-        }
-    } while( fabs(Xe - Xep) > tol ); /* Check our value */
+    } while(fabs(Xe - Xep) > tol && hi - lo > tol && iter < maxiter);
 
     /* Print out how many iterations it took to find Xe */
-    printf("Solution converged after %d iterations.\n", iter);
+    if(iter < maxiter)
+        printf("Solution converged after %d iterations.\n", iter);
+    else
+        printf("Failure to converge after %d iterations.\n", iter);
     printf("kF = %g\n", kF);
 
     return Xe;
 }
-
@@ -0,0 +1,149 @@
+/**
+ * @file batch.c
+ * Run the kF analysis on a whole set of data files at once.
+ */
+
+#include "kf.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Load a list of data files to process. Each line of the manifest has the
+ * form
+ *
+ *     file,Mdry,L0[,Xe]
+ *
+ * where Mdry is the bone dry mass [mg], L0 is the initial thickness [mm], and
+ * Xe is an optional equilibrium moisture content [kg/kg db]. Blank lines,
+ * lines starting with #, and lines without numbers (like a header) are
+ * skipped. Lines (and file names) can be any length.
+ * @param file Name of the manifest file
+ * @param T Drying temperature to use for every job [K]
+ * @param njobs Set to the number of jobs loaded
+ * @returns Array of jobs, or NULL if the file can't be read.
+ */
+kfjob* LoadManifest(char *file, double T, int *njobs)
+{
+    FILE *fp;
+    char *line = NULL, /* Line buffer, grown to fit the longest line */
+         *comma;
+    size_t linesize = 0; /* Size of the line buffer */
+    kfjob *jobs = NULL;
+    int n = 0, /* Number of jobs loaded */
+        size = 0, /* Number of jobs there is room for */
+        nread; /* Number of values read from each line */
+    double Mdry, L0, Xe;
+
+    *njobs = 0;
+    fp = fopen(file, "r");
+    if(!fp)
+        return NULL;
+
+    while(getline(&line, &linesize, fp) >= 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        comma = strchr(line, ',');
+        if(line[0] == '#' || !comma)
+            continue;
+
+        nread = sscanf(comma+1, "%lf,%lf,%lf", &Mdry, &L0, &Xe);
+        if(nread < 2)
+            continue;
+
+        if(n == size) {
+            size = size ? 2*size : 16;
+            jobs = (kfjob*) realloc(jobs, sizeof(kfjob)*size);
+        }
+
+        *comma = '\0';
+        jobs[n].file = strdup(line);
+        jobs[n].Mdry = Mdry;
+        jobs[n].L0 = L0/1000; /* Convert to meters for calculations */
+        jobs[n].Xe = (nread == 3) ? Xe : -1;
+        jobs[n].T = T;
+        jobs[n].window = 0;
+        jobs[n].stride = 1;
+        jobs[n].precision = 0;
+        jobs[n].columns = NULL;
+        jobs[n].cache = NULL;
+        jobs[n].dectol = 0;
+        jobs[n].expand = 0;
+        jobs[n].Dtab = NULL;
+        n++;
+    }
+    fclose(fp);
+    free(line);
+
+    *njobs = n;
+    return jobs;
+}
+
+/**
+ * Free a list of jobs loaded by LoadManifest.
+ * @param jobs Array of jobs
+ * @param njobs Number of jobs
+ */
+void DestroyManifest(kfjob *jobs, int njobs)
+{
+    int i;
+    for(i=0; i<njobs; i++)
+        free(jobs[i].file);
+    free(jobs);
+}
+
+/**
+ * Process each job in the list and write a summary table. Jobs are run in
+ * parallel, one per thread, so at most nthreads data sets are in memory at
+ * any given time. Each data file gets its own output file (see kFRun), and
+ * the summary has one row per file with the equilibrium moisture content, the
+ * average kF, the fitted diffusivity parameters, and the initial point.
+ * @param jobs Array of jobs
+ * @param njobs Number of jobs
+ * @param nthreads Number of threads to use. If zero, use all of them.
+ * @param summary Name of the file to save the summary to
+ * @returns Number of jobs that failed
+ */
+int kFBatch(kfjob *jobs, int njobs, int nthreads, char *summary)
+{
+    kfsummary *s; /* Results for each job */
+    int *status, /* Return value from each job */
+        i, nfail = 0;
+    FILE *fp;
+
+    s = (kfsummary*) calloc(sizeof(kfsummary), njobs);
+    status = (int*) calloc(sizeof(int), njobs);
+
+#ifdef _OPENMP
+    if(nthreads > 0)
+        omp_set_num_threads(nthreads);
+#endif
+#pragma omp parallel for schedule(dynamic)
+    for(i=0; i<njobs; i++)
+        status[i] = kFRun(&jobs[i], &s[i]);
+
+    fp = fopen(summary, "w");
+    if(fp)
+        fprintf(fp, "File,Xe [kg/kg db],Mean kF [1/s],D0 [m^2/s],k [kg db/kg],Initial Row,Rows\n");
+    for(i=0; i<njobs; i++) {
+        if(status[i]) {
+            nfail++;
+            continue;
+        }
+        if(fp)
+            fprintf(fp, "%s,%g,%g,%g,%g,%d,%d\n", jobs[i].file, s[i].Xe,
+                    s[i].kFmean, s[i].D0, s[i].Dk, s[i].p0, s[i].nrows);
+    }
+    if(fp)
+        fclose(fp);
+    else
+        fprintf(stderr, "Unable to open %s\n", summary);
+
+    free(s);
+    free(status);
+
+    return nfail;
+}
@@ -0,0 +1,257 @@
+/**
+ * @file cache.c
+ * On-disk cache for the slow parts of the kF analysis. Each result is saved
+ * under a key made by hashing (FNV-1a) everything it depends on: the data
+ * itself and whatever parameters that stage uses. Running the same data file
+ * again with a different thickness or set of output columns finds the
+ * equilibrium moisture content and kF values already there, and renaming or
+ * copying the file doesn't matter since only the contents are hashed.
+ * Results are saved as column files in the cache directory.
+ *
+ * The cache is used unless it's turned off (kF -n), and by default it is
+ * KFCACHEDIR in the current directory. Nothing is ever removed from it, so it
+ * grows by about one copy of the data for every new file or Xe analyzed;
+ * deleting the directory clears it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "kf.h"
+#include "colfile.h"
+
+#define FNVPRIME UINT64_C(0x100000001b3)
+#define KFCACHEVERSION 1 /* Change this when any cached calculation changes */
+
+static int CacheHits = 0, /* Number of results loaded from the cache */
+           CacheMisses = 0; /* Number of results that had to be calculated */
+
+/**
+ * Add a block of memory to an FNV-1a hash.
+ * @param h Hash so far (start with FNVINIT)
+ * @param data Data to add
+ * @param n Number of bytes
+ * @returns New hash
+ */
+uint64_t FNV1a(uint64_t h, const void *data, size_t n)
+{
+    const unsigned char *p = (const unsigned char*) data;
+    size_t i;
+
+    for(i=0; i<n; i++) {
+        h ^= p[i];
+        h *= FNVPRIME;
+    }
+
+    return h;
+}
+
+/**
+ * Add a number to a hash.
+ */
+uint64_t FNV1aDouble(uint64_t h, double x)
+{
+    return FNV1a(h, &x, sizeof(double));
+}
+
+/**
+ * Add every element of a vector (and its length) to a hash.
+ */
+uint64_t FNV1aVector(uint64_t h, vector *v)
+{
+    int i;
+
+    h = FNV1aDouble(h, len(v));
+    for(i=0; i<len(v); i++)
+        h = FNV1aDouble(h, valV(v, i));
+
+    return h;
+}
+
+/**
+ * Cache key for kF at every row. kF only depends on the data and Xe, so
+ * calckf and kFWriteColumns save the same values under this key (with stage
+ * KFCACHEKF) and can use each other's results.
+ * @param t Time [s]
+ * @param X Moisture content [kg/kg db]
+ * @param Xe Equilibrium moisture content [kg/kg db]
+ * @returns Hash of the inputs
+ */
+uint64_t kFCacheKeykF(vector *t, vector *X, double Xe)
+{
+    return FNV1aDouble(FNV1aVector(FNV1aVector(FNVINIT, t), X), Xe);
+}
+
+/**
+ * Name of the cache file for a result. The name of the calculation and
+ * KFCACHEVERSION are added to the key, so results from different stages (or
+ * older versions of the program) are never mixed up.
+ * @param dir Cache directory
+ * @param stage Name of the calculation, such as "Xe"
+ * @param key Hash of the inputs
+ * @returns Newly allocated file name
+ */
+static char* kFCacheFile(char *dir, char *stage, uint64_t key)
+{
+    char *file;
+
+    key = FNV1aDouble(FNV1a(key, stage, strlen(stage)), KFCACHEVERSION);
+    file = (char*) calloc(sizeof(char), strlen(dir) + strlen(stage) + 24);
+    sprintf(file, "%s/%s-%016" PRIx64 ".col", dir, stage, key);
+
+    return file;
+}
+
+/**
+ * Look for a result in the cache. Every lookup counts as either a hit or a
+ * miss in the statistics.
+ * @param dir Cache directory, or NULL if caching is turned off
+ * @param stage Name of the calculation, such as "kF"
+ * @param key Hash of everything the result depends on
+ * @param n Number of values expected
+ * @returns Table with the values in the first column, or NULL on a miss
+ */
+csvtable* kFCacheLoad(char *dir, char *stage, uint64_t key, int n)
+{
+    csvtable *t;
+    char *file;
+
+    if(!dir)
+        return NULL;
+
+    file = kFCacheFile(dir, stage, key);
+    t = ColFileLoad(file);
+    free(file);
+    if(t && (t->ncols != 1 || t->nrows != n)) {
+        DestroyCSVTable(t);
+        t = NULL;
+    }
+
+    if(t) {
+#pragma omp atomic
+        CacheHits++;
+    } else {
+#pragma omp atomic
+        CacheMisses++;
+    }
+
+    return t;
+}
+
+/**
+ * Save a result to the cache. The cache directory is made if it isn't there
+ * yet. Nothing happens if the result can't be saved.
+ * @param dir Cache directory, or NULL if caching is turned off
+ * @param stage Name of the calculation, such as "kF"
+ * @param key Hash of everything the result depends on
+ * @param v Values to save
+ * @param n Number of values
+ */
+void kFCacheSave(char *dir, char *stage, uint64_t key, double *v, int n)
+{
+    csvtable t;
+    char *file;
+
+    if(!dir)
+        return;
+
+    memset(&t, 0, sizeof(csvtable));
+    t.nrows = n;
+    t.ncols = 1;
+    t.col = &v;
+
+    mkdir(dir, 0755);
+    file = kFCacheFile(dir, stage, key);
+    ColFileWrite(file, &t, stage);
+    free(file);
+}
+
+/**
+ * Same as CalcXeIt, but using the cache.
+ * @param dir Cache directory, or NULL if caching is turned off
+ * @param p0 Initial data point
+ * @param t Time [s]
+ * @param X Moisture content [kg/kg db]
+ * @param w Weight of each point, or NULL
+ * @param Xguess Initial guess for Xe
+ * @returns Equilibrium moisture content [kg/kg db]
+ */
+double kFCachedXeIt(char *dir, int p0, vector *t, vector *X, vector *w,
+                    double Xguess)
+{
+    csvtable *c;
+    uint64_t key = FNVINIT;
+    double Xe;
+
+    if(dir) {
+        key = FNV1aVector(FNV1aVector(key, t), X);
+        key = FNV1aDouble(FNV1aDouble(key, p0), Xguess);
+        if(w)
+            key = FNV1aVector(key, w);
+    }
+
+    c = kFCacheLoad(dir, "Xe", key, 1);
+    if(c) {
+        Xe = csvval(c, 0, 0);
+        DestroyCSVTable(c);
+        return Xe;
+    }
+
+    Xe = CalcXeIt(p0, t, X, w, Xguess);
+    kFCacheSave(dir, "Xe", key, &Xe, 1);
+
+    return Xe;
+}
+
+/**
+ * Same as calckf, but using the cache.
+ * @param dir Cache directory, or NULL if caching is turned off
+ * @param t Time [s]
+ * @param X Moisture content [kg/kg db]
+ * @param Xe Equilibrium moisture content [kg/kg db]
+ * @returns Vector of kF values
+ */
+vector* kFCachedCalckf(char *dir, vector *t, vector *X, double Xe)
+{
+    csvtable *c;
+    vector *kF;
+    double *v;
+    uint64_t key = FNVINIT;
+    int i;
+
+    if(dir)
+        key = kFCacheKeykF(t, X, Xe);
+
+    c = kFCacheLoad(dir, KFCACHEKF, key, len(t));
+    if(c) {
+        kF = CSVColumnVector(c, 0);
+        DestroyCSVTable(c);
+        return kF;
+    }
+
+    kF = calckf(t, X, Xe);
+    if(dir) {
+        v = (double*) calloc(sizeof(double), len(kF));
+        for(i=0; i<len(kF); i++)
+            v[i] = valV(kF, i);
+        kFCacheSave(dir, KFCACHEKF, key, v, len(kF));
+        free(v);
+    }
+
+    return kF;
+}
+
+/**
+ * Print the number of results loaded from the cache so far.
+ * @param dir Cache directory, or NULL if caching is turned off
+ */
+void PrintkFCacheStats(char *dir)
+{
+    if(!dir)
+        return;
+    printf("Cache (%s): %d hits, %d misses\n", dir, CacheHits, CacheMisses);
+}
+
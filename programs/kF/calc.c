@@ -6,6 +6,7 @@
 #include "kf.h"
 #include "matrix.h"
 #include "regress.h"
+#include <math.h>
 
 /**
  * Fit a certain number of rows out of the supplied data
@@ -23,6 +24,7 @@ double fitsubset(matrix *x, matrix *y, int rowstart, int rowend)
            *beta0; /* Initial value for beta */
     int nrows = rowend-rowstart, /* Number of rows to fit */
         i; /* Loop index */
+    double kF; /* Fitted value */
 
     /* Make all the matricies */
     xx = CreateMatrix(nrows, 1);
@@ -40,9 +42,16 @@ double fitsubset(matrix *x, matrix *y, int rowstart, int rowend)
 
     /* Fit the data */
     beta = fitnlm(&CrankModel, xx, yy, beta0);
+    kF = val(beta, 0, 0);
+
+    /* Clean up */
+    DestroyMatrix(xx);
+    DestroyMatrix(yy);
+    DestroyMatrix(beta0);
+    DestroyMatrix(beta);
 
     /* Return the value for kF */
-    return val(beta, 0, 0);
+    return kF;
 }
 
 /**
@@ -163,3 +172,132 @@ matrix* fitkf(matrix *t, matrix *Xdb)
     return kf;
 }
 
+
+/**
+ * Add (or remove) one data point's contribution to the Gauss-Newton sums used
+ * by slidekf. The residual and derivative are evaluated at kF = kf.
+ * @param kf Value of kF to evaluate the Crank equation at [1/s]
+ * @param t Time [s]
+ * @param X Moisture content [kg/kg db]
+ * @param X0 Initial moisture content [kg/kg db]
+ * @param Xe Equilibrium moisture content [kg/kg db]
+ * @param sign 1 to add the point, -1 to remove it
+ * @param Srj Sum of residual times derivative
+ * @param Sjj Sum of squared derivatives
+ */
+static void slidekfsums(double kf, double t, double X, double X0, double Xe,
+                        double sign, double *Srj, double *Sjj)
+{
+    double r = CrankEquation(kf, t, X0, Xe, CONSTnterms) - X,
+           j = CrankEquationDkF(kf, t, X0, Xe, CONSTnterms);
+
+    *Srj += sign*r*j;
+    *Sjj += sign*j*j;
+}
+
+/**
+ * Calculate kF by fitting the Crank equation over a window of data points that
+ * slides along the data set. Each window is fit with Gauss-Newton, starting
+ * from the previous window's value. The sums for the fit are kept for a fixed
+ * linearization point: when the window moves, only the rows that leave and
+ * enter it are updated, and a single Gauss-Newton step from those sums gives
+ * the new kF. The sums are only recalculated over the whole window once kF has
+ * drifted far enough from the linearization point that the single step is no
+ * longer accurate. This gives a smooth kF curve for roughly the cost of one
+ * pass through the data.
+ * @param t Vector of times [s]
+ * @param Xdb Vector of moisture contents [kg/kg db]
+ * @param Xe Equilibrium moisture content [kg/kg db]
+ * @param window Number of points in each window
+ * @param stride Number of points to move the window each step
+ * @returns Vector of kF values [1/s], one for each row. Each row gets the
+ *      value from the window centered closest to it. Windows where the fit
+ *      says nothing about kF (every derivative is zero, as for a single point
+ *      at t = 0) give NaN.
+ *
+ * @see fitkf calckf
+ */
+vector* slidekf(vector *t, vector *Xdb, double Xe, int window, int stride)
+{
+    vector *kF;
+    int n = len(t), /* Number of data points */
+        start, /* First row in the current window */
+        prev, /* First row in the previous window */
+        center = 0, /* Row at the center of the current window */
+        i, /* Loop index */
+        iter; /* Gauss-Newton iterations for the current window */
+    double X0 = valV(Xdb, 0), /* Same initial point as calckf */
+           kfs = BETA0, /* Linearization point for the sums */
+           kfw = BETA0, /* kF for the current window */
+           dk, /* Gauss-Newton step */
+           Srj = 0, /* Sum of residual times derivative */
+           Sjj = 0, /* Sum of squared derivatives */
+           relin = 1e-3, /* Relative step that triggers recalculating the sums */
+           tol = 1e-10; /* Tolerance for the first window */
+    int maxiter = 100; /* Maximum number of iterations per window */
+
+    kF = CreateVector(n);
+    if(window > n)
+        window = n;
+    if(stride < 1)
+        stride = 1;
+
+    prev = -1;
+    for(start=0; start+window<=n; start+=stride) {
+        if(prev < 0 || start-prev >= window) {
+            /* No overlap with the previous window, so start from scratch */
+            Srj = 0;
+            Sjj = 0;
+            for(i=start; i<start+window; i++)
+                slidekfsums(kfs, valV(t, i), valV(Xdb, i), X0, Xe, 1, &Srj, &Sjj);
+        } else {
+            /* Drop the rows that left the window and add the new ones */
+            for(i=prev; i<start; i++)
+                slidekfsums(kfs, valV(t, i), valV(Xdb, i), X0, Xe, -1, &Srj, &Sjj);
+            for(i=prev+window; i<start+window; i++)
+                slidekfsums(kfs, valV(t, i), valV(Xdb, i), X0, Xe, 1, &Srj, &Sjj);
+        }
+        prev = start;
+
+        /* Gauss-Newton. Only relinearize if the step is too large for a single
+         * step to be accurate (or for the first window, until converged). kF
+         * has to stay positive, so any step that would make it negative just
+         * halves it instead, until it's small enough to call zero. */
+        iter = 0;
+        dk = (Sjj > 0) ? -Srj/Sjj : 0;
+        while(Sjj > 0 && iter++ < maxiter
+                && !(fabs(dk) <= relin*kfs && (start > 0 || fabs(dk) <= tol))) {
+            if(kfs + dk > 0)
+                kfs += dk;
+            else if(kfs > tol)
+                kfs /= 2;
+            else
+                break;
+            Srj = 0;
+            Sjj = 0;
+            for(i=start; i<start+window; i++)
+                slidekfsums(kfs, valV(t, i), valV(Xdb, i), X0, Xe, 1, &Srj, &Sjj);
+            dk = (Sjj > 0) ? -Srj/Sjj : 0;
+        }
+        if(!(Sjj > 0))
+            kfw = NAN;
+        else
+            kfw = (kfs + dk > 0) ? kfs + dk : kfs;
+
+        /* Save the value for the rows closest to the center of this window */
+        center = start + window/2;
+        for(i=center-stride/2; i<center-stride/2+stride && i<n; i++)
+            if(i >= 0)
+                setvalV(kF, i, kfw);
+        /* Fill in the rows before the first window's center */
+        if(start == 0)
+            for(i=0; i<center-stride/2; i++)
+                setvalV(kF, i, kfw);
+    }
+
+    /* Fill in anything past the last window's center */
+    for(i=center-stride/2+stride; i<n; i++)
+        setvalV(kF, i, kfw);
+
+    return kF;
+}
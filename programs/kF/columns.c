@@ -0,0 +1,572 @@
+/**
+ * @file columns.c
+ * Calculate the columns of the kF output file one row at a time. Only the
+ * columns asked for (and whatever they depend on) are calculated, values used
+ * by more than one column are only calculated once per row, and each row is
+ * written out as soon as it's done.
+ */
+
+#include "kf.h"
+#include "matrix.h"
+#include "csv.h"
+#include "material-data.h"
+#include "sample.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define KFCOLDEFAULT "t,X,kF,Lwat,D" /* Columns to output by default */
+#define KFBLOCK 4096 /* Rows calculated and formatted at a time */
+
+/**
+ * Name and header for each column that can be output. The order matches the
+ * KFCOL_ definitions in kf.h.
+ */
+static const char *KFColName[KFNCOLS] = {"t", "X", "kF", "kFw", "L", "De",
+    "Lwat", "Lconst", "D", "MFlux", "PFlux"};
+static const char *KFColHeader[KFNCOLS] = {
+    "Time [s]",
+    "Moisture Content [kg/kg db]",
+    "kF",
+    "kF (window)",
+    "Thickness (from D) [m]",
+    "Deborah Number",
+    "Thickness [m]",
+    "Thickness (constant D) [m]",
+    "D [m^2/s]",
+    "Mass Flux [kg/(m^2 s)]",
+    "Momentum Flux [kg/(m^2 s)]"};
+
+/**
+ * Everything that stays the same from one row to the next.
+ */
+typedef struct {
+    vector *t, *X, *kFw; /* Input data and windowed kF values */
+    vector *w; /* Weight of each row (see DecimateWeights), or NULL */
+    int p0, /* Initial data point */
+        need[KFNCOLS]; /* Which columns need to be calculated */
+    double Xe, /* Equilibrium moisture content [kg/kg db] */
+           X0, /* Moisture content at the first row [kg/kg db] */
+           L0, /* Initial thickness [m] */
+           T, /* Drying temperature [K] */
+           Mdry, /* Bone dry mass [kg] */
+           Dkf0, /* Diffusivity at p0 from the kF value [m^2/s] */
+           D0, /* Diffusivity at p0 from the model [m^2/s] */
+           tr, /* Mean relaxation time [s] */
+           rho0, /* Density at p0 [kg/m^3] */
+           rhop; /* Density of the dry sample [kg/m^3] */
+    pastadensity *dens; /* Density at the drying temperature */
+    proptable *Dtab; /* Diffusivity table, if there is one */
+    int block; /* Last flux averaging block calculated */
+    double mflux, pflux; /* Flux values for that block */
+    double *kFc, /* kF for every row from the cache, or NULL */
+           *kFnew; /* kF for every row to save to the cache, or NULL */
+} kfcols;
+
+/**
+ * Running sums for the summary of a run (see kfsummary).
+ */
+typedef struct {
+    double nkF, /* Total weight of finite kF values */
+           kF, /* Weighted sum of finite kF values */
+           n, x, y, xx, xy; /* Sums for the fit of ln(D) against X */
+} kfsums;
+
+/**
+ * Turn a comma separated list of column names into a list of column numbers.
+ * @param list Column names, such as "t,X,kF". If this is NULL, the default
+ *      columns are used.
+ * @param ncols Set to the number of columns
+ * @returns Newly allocated array of column numbers, or NULL if any of the
+ *      names aren't recognized or no columns are listed. There is room for
+ *      one more column after the last one.
+ */
+int* ParsekFColumns(char *list, int *ncols)
+{
+    char *copy, *name, *save, *p;
+    int *cols, n = 0, maxcols = 1, i;
+
+    copy = strdup(list ? list : KFCOLDEFAULT);
+    /* Each comma adds at most one name, plus one spare for the caller */
+    for(p=copy; *p; p++)
+        if(*p == ',')
+            maxcols++;
+    cols = (int*) calloc(sizeof(int), maxcols+1);
+
+    for(name=strtok_r(copy, ",", &save); name; name=strtok_r(NULL, ",", &save)) {
+        for(i=0; i<KFNCOLS; i++)
+            if(strcmp(name, KFColName[i]) == 0)
+                break;
+        if(i == KFNCOLS) {
+            fprintf(stderr, "Unknown column: %s\n", name);
+            free(cols);
+            free(copy);
+            return NULL;
+        }
+        cols[n++] = i;
+    }
+    free(copy);
+
+    if(n == 0) {
+        fprintf(stderr, "No columns selected\n");
+        free(cols);
+        return NULL;
+    }
+
+    *ncols = n;
+    return cols;
+}
+
+/**
+ * Print the list of column names for the usage statement.
+ */
+void PrintkFColumns()
+{
+    int i;
+    for(i=0; i<KFNCOLS; i++)
+        printf("    %-7s %s\n", KFColName[i], KFColHeader[i]);
+    printf("    Default: %s\n", KFCOLDEFAULT);
+}
+
+/**
+ * Diffusivity from the model at the drying temperature.
+ * @param c Column state
+ * @param X Moisture content [kg/kg db]
+ * @returns Diffusivity [m^2/s]
+ */
+static double kFDiff(kfcols *c, double X)
+{
+    return c->Dtab ? PropTableVal(c->Dtab, X) : DiffCh10(X, c->T);
+}
+
+/**
+ * Thickness of the sample from kF and the diffusivity model (same as
+ * NewLength).
+ * @param c Column state
+ * @param kFi kF value [1/s]
+ * @param Di Diffusivity from the model [m^2/s]
+ * @returns Thickness [m]
+ */
+static double kFLength(kfcols *c, double kFi, double Di)
+{
+    return sqrt(M_PI*M_PI*Di/c->D0*c->Dkf0/kFi);
+}
+
+/**
+ * kF for a row, from the cache if it's there.
+ * @param c Column state
+ * @param i Row number
+ * @returns kF [1/s]
+ */
+static double kFRowkF(kfcols *c, int i)
+{
+    if(c->kFc)
+        return c->kFc[i];
+    return CrankkF(valV(c->t, i), valV(c->X, i), c->X0, c->Xe, BETA0);
+}
+
+/**
+ * Thickness of the sample at any row, for the flux calculations.
+ * @param c Column state
+ * @param i Row number
+ * @returns Thickness [m]
+ */
+static double kFLengthRow(kfcols *c, int i)
+{
+    double Xi = valV(c->X, i);
+
+    if(i < c->p0)
+        return c->L0;
+    return kFLength(c, kFRowkF(c, i), kFDiff(c, Xi));
+}
+
+/**
+ * Calculate the mass and momentum flux for the averaging block that a row is
+ * in. Fluxes are calculated every NPTS rows starting at p0 (see MassFlux and
+ * PastaMassFlux), and every row in the block leading up to that point gets
+ * the average value. Rows past the last full block are zero.
+ * @param c Column state
+ * @param j Row number
+ */
+static void kFFluxBlock(kfcols *c, int j)
+{
+    int k, i;
+    double dt;
+
+    k = (j >= c->p0) ? (j - c->p0)/NPTS + 1 : -((c->p0 - j - 1)/NPTS);
+    if(k == c->block)
+        return;
+    c->block = k;
+
+    i = c->p0 + k*NPTS;
+    if(k < 0 || i >= len(c->t) || i < NPTS) {
+        c->mflux = c->pflux = (k < 0 || i >= len(c->t)) ? 0 : NAN;
+        return;
+    }
+
+    dt = valV(c->t, i) - valV(c->t, i-NPTS);
+    if(c->need[KFCOL_MFLUX])
+        c->mflux = 0.5*(valV(c->X, i) - valV(c->X, i-NPTS))/dt * c->Mdry
+            / (SLABLENGTH*SLABWIDTH) / NPTS;
+    if(c->need[KFCOL_PFLUX])
+        c->pflux = 0.5*(kFLengthRow(c, i) - kFLengthRow(c, i-NPTS))/dt
+            * c->rhop / NPTS;
+}
+
+/**
+ * Calculate the selected columns for a single row.
+ * @param c Column state
+ * @param i Row number
+ * @param v Array of KFNCOLS values. Only the needed ones are set.
+ */
+static void kFRowValues(kfcols *c, int i, double *v)
+{
+    double ti = valV(c->t, i),
+           Xi = valV(c->X, i),
+           kFi = NAN, Di = NAN, Li = NAN, D;
+
+    v[KFCOL_T] = ti;
+    v[KFCOL_X] = Xi;
+    if(c->need[KFCOL_KF]) {
+        kFi = v[KFCOL_KF] = kFRowkF(c, i);
+        if(c->kFnew)
+            c->kFnew[i] = kFi;
+    }
+    if(c->need[KFCOL_KFW])
+        v[KFCOL_KFW] = valV(c->kFw, i);
+    if(c->need[KFCOL_D])
+        Di = v[KFCOL_D] = kFDiff(c, Xi);
+    if(c->need[KFCOL_LWAT])
+        v[KFCOL_LWAT] = c->rho0/PastaDensity(c->dens, Xi) * c->L0;
+
+    if(i < c->p0) {
+        v[KFCOL_L] = c->L0;
+        v[KFCOL_DE] = 0;
+        v[KFCOL_LCONST] = c->L0;
+    } else {
+        if(c->need[KFCOL_L])
+            v[KFCOL_L] = Li = kFLength(c, kFi, Di);
+        if(c->need[KFCOL_LCONST])
+            v[KFCOL_LCONST] = sqrt(M_PI*M_PI*c->Dkf0/kFi);
+
+        /* Same as DeborahNumber */
+        if(c->need[KFCOL_DE]) {
+            D = Di/c->D0*c->Dkf0;
+            Li = Li/2;
+            v[KFCOL_DE] = c->tr/(Li*Li/D);
+        }
+    }
+
+    if(c->need[KFCOL_MFLUX] || c->need[KFCOL_PFLUX]) {
+        kFFluxBlock(c, i);
+        v[KFCOL_MFLUX] = c->mflux;
+        v[KFCOL_PFLUX] = c->pflux;
+    }
+}
+
+/**
+ * Add the values from one row to the summary sums.
+ * @param sum Sums to add to
+ * @param v Values for the row (kF and Lwat must be set)
+ * @param wi Number of original rows this row stands for (1 unless the data
+ *      was decimated)
+ */
+static void kFAddRowSums(kfsums *sum, double *v, double wi)
+{
+    double x, y;
+
+    if(isfinite(v[KFCOL_KF])) {
+        sum->kF += wi*v[KFCOL_KF];
+        sum->nkF += wi;
+    }
+    /* Linear fit of ln(kF L^2/pi^2) against X */
+    if(v[KFCOL_KF] > 0) {
+        x = v[KFCOL_X];
+        y = log(v[KFCOL_KF]*v[KFCOL_LWAT]*v[KFCOL_LWAT]/(M_PI*M_PI));
+        sum->n += wi;
+        sum->x += wi*x;
+        sum->y += wi*y;
+        sum->xx += wi*x*x;
+        sum->xy += wi*x*y;
+    }
+}
+
+/**
+ * Calculate the selected columns for a block of rows and format them as csv
+ * text.
+ * @param c Column state
+ * @param start First row of the block
+ * @param end One past the last row of the block
+ * @param cols List of columns to output
+ * @param ncols Number of columns
+ * @param sum Summary sums for the block. May be NULL.
+ * @param precision Significant digits, or 0 for the shortest round trip
+ * @param size Set to the length of the text
+ * @returns Newly allocated text for the block
+ */
+static char* kFBlock(kfcols *c, int start, int end, int *cols, int ncols,
+                     kfsums *sum, int precision, size_t *size)
+{
+    double v[KFNCOLS];
+    char *text, *p;
+    int i, j;
+
+    text = (char*) malloc((size_t) (end-start)*(ncols*(CSVFIELDMAX+1)+1));
+    p = text;
+    for(i=start; i<end; i++) {
+        kFRowValues(c, i, v);
+        for(j=0; j<ncols; j++) {
+            if(j)
+                *p++ = ',';
+            p += CSVFormatDouble(p, v[cols[j]], precision);
+        }
+        *p++ = '\n';
+
+        if(sum && i >= c->p0)
+            kFAddRowSums(sum, v, c->w ? valV(c->w, i) : 1);
+    }
+    *size = p - text;
+
+    return text;
+}
+
+/**
+ * Calculate the selected columns for every row of decimated data, expand them
+ * back out to every row of the original data, and write them. Time and
+ * moisture content come from the original data, and every other column is
+ * linearly interpolated in time between the rows that were kept (see
+ * ExpandVector). The decimated data is small, so it's all kept in memory.
+ * @param c Column state
+ * @param tfull Time at each row of the original data [s]
+ * @param Xfull Moisture content at each row of the original data [kg/kg db]
+ * @param cols List of columns to output
+ * @param ncols Number of columns
+ * @param sum Summary sums. May be NULL.
+ * @param out csv writer to write the rows to
+ */
+static void kFWriteExpanded(kfcols *c, vector *tfull, vector *Xfull,
+                            int *cols, int ncols, kfsums *sum,
+                            csvwriter *out)
+{
+    double v[KFNCOLS];
+    vector **vd, /* Values at each decimated row */
+           **ve; /* Values at each original row */
+    int i, j;
+
+    vd = (vector**) calloc(sizeof(vector*), ncols);
+    ve = (vector**) calloc(sizeof(vector*), ncols);
+    for(j=0; j<ncols; j++)
+        if(cols[j] != KFCOL_T && cols[j] != KFCOL_X)
+            vd[j] = CreateVector(len(c->t));
+
+    for(i=0; i<len(c->t); i++) {
+        kFRowValues(c, i, v);
+        for(j=0; j<ncols; j++)
+            if(vd[j])
+                setvalV(vd[j], i, v[cols[j]]);
+        if(sum && i >= c->p0)
+            kFAddRowSums(sum, v, c->w ? valV(c->w, i) : 1);
+    }
+
+    for(j=0; j<ncols; j++) {
+        if(cols[j] == KFCOL_T)
+            ve[j] = tfull;
+        else if(cols[j] == KFCOL_X)
+            ve[j] = Xfull;
+        else
+            ve[j] = ExpandVector(c->t, vd[j], tfull);
+    }
+    CSVWriteVectors(out, ve, ncols, NULL, 0);
+
+    for(j=0; j<ncols; j++) {
+        if(vd[j]) {
+            DestroyVector(vd[j]);
+            DestroyVector(ve[j]);
+        }
+    }
+    free(vd);
+    free(ve);
+}
+
+/**
+ * Calculate the selected columns for every row and write them to a csv file.
+ * The rows are split into blocks of KFBLOCK, and each stage after loading the
+ * data (kF, the derived values, and formatting the text) is done a block at a
+ * time on whichever thread is free. Blocks are written to the file in order
+ * as soon as they and every block before them are done, so writing overlaps
+ * with the calculations, and only about one block per thread is ever stored.
+ * If a summary is requested, the average kF and the fit of
+ * \f$D = D_0 \exp(k X)\f$ (using the kF values and the thickness from
+ * density change) are found in the same pass.
+ *
+ * If the data was decimated, each row counts in the summary as many times as
+ * the number of original rows it stands for. The flux columns average over a
+ * fixed number of rows, so they can't be calculated from decimated data.
+ * Decimated results can be expanded back out to every original row before
+ * they're written (see kFWriteExpanded).
+ * @param job Data file and sample parameters
+ * @param t Time [s]
+ * @param X Moisture content [kg/kg db]
+ * @param w Weight of each row (see DecimateWeights), or NULL if the data
+ *      wasn't decimated
+ * @param tfull Time at each row of the original data [s], or NULL to write
+ *      just the rows in t
+ * @param Xfull Moisture content at each row of the original data
+ *      [kg/kg db], or NULL
+ * @param kFw Windowed kF values, or NULL if they weren't calculated
+ * @param p0 Initial data point
+ * @param Xe Equilibrium moisture content [kg/kg db]
+ * @param cols List of columns to output (see ParsekFColumns)
+ * @param ncols Number of columns
+ * @param outfile Name of the file to save the results to
+ * @param s Summary of the results. May be NULL.
+ * @returns 0 on success
+ */
+int kFWriteColumns(kfjob *job, vector *t, vector *X, vector *w,
+                   vector *tfull, vector *Xfull, vector *kFw, int p0,
+                   double Xe, int *cols, int ncols, char *outfile,
+                   kfsummary *s)
+{
+    kfcols c;
+    kfsums sum, /* Summary sums for the whole run */
+           bsum; /* Summary sums for one block */
+    maxwell *m;
+    csvtable *kFcache = NULL; /* Cached kF values */
+    double kf0;
+    int b, j,
+        status, /* Return value */
+        nblocks; /* Number of blocks of rows */
+    char *text; /* Formatted text for a block */
+    size_t size;
+    uint64_t key = 0; /* Hash of the inputs for kF */
+    csvwriter *out; /* Output file */
+
+    memset(&c, 0, sizeof(kfcols));
+    memset(&sum, 0, sizeof(kfsums));
+    for(j=0; j<ncols; j++) {
+        if(cols[j] == KFCOL_KFW && !kFw) {
+            fprintf(stderr, "The kFw column needs a window size (-w)\n");
+            return 1;
+        }
+        if((cols[j] == KFCOL_MFLUX || cols[j] == KFCOL_PFLUX) && w) {
+            fprintf(stderr, "The %s column can't be used with -d\n",
+                    KFColName[cols[j]]);
+            return 1;
+        }
+        c.need[cols[j]] = 1;
+    }
+
+    /* Work out what the selected columns depend on */
+    if(s)
+        c.need[KFCOL_KF] = c.need[KFCOL_LWAT] = 1;
+    if(c.need[KFCOL_DE])
+        c.need[KFCOL_L] = 1;
+    if(c.need[KFCOL_L])
+        c.need[KFCOL_KF] = c.need[KFCOL_D] = 1;
+    if(c.need[KFCOL_LCONST])
+        c.need[KFCOL_KF] = 1;
+
+    out = CreateCSVWriter(outfile, job->precision, 1);
+    if(!out) {
+        fprintf(stderr, "Unable to open %s\n", outfile);
+        return 1;
+    }
+
+    c.t = t;
+    c.X = X;
+    c.w = w;
+    c.kFw = kFw;
+    c.p0 = p0;
+    c.Xe = Xe;
+    c.X0 = valV(X, 0);
+    c.L0 = job->L0;
+    c.T = job->T;
+    c.Mdry = job->Mdry*1e-6;
+    c.block = INT_MIN;
+    c.Dtab = job->Dtab;
+
+    /* Values that are the same for every row */
+    kf0 = CrankkF(valV(t, p0), valV(X, p0), c.X0, Xe, BETA0);
+    c.Dkf0 = kf0*c.L0*c.L0/(M_PI*M_PI);
+    c.D0 = kFDiff(&c, valV(X, p0));
+    if(c.need[KFCOL_LWAT] || c.need[KFCOL_PFLUX]) {
+        c.dens = CreatePastaDensity(PASTACOMP, c.T);
+        c.rho0 = PastaDensity(c.dens, valV(X, p0));
+        c.rhop = PastaDensity(c.dens, 0);
+    }
+    if(c.need[KFCOL_DE]) {
+        m = CreateMaxwell();
+        c.tr = MeanRelaxTime(m);
+        DestroyMaxwell(m);
+    }
+
+    /* kF at every row only depends on the data and Xe, so it can be loaded
+     * from the cache, or saved to it once every row has been calculated. */
+    if(job->cache && (c.need[KFCOL_KF] || c.need[KFCOL_PFLUX])) {
+        key = kFCacheKeykF(t, X, Xe);
+        kFcache = kFCacheLoad(job->cache, KFCACHEKF, key, len(t));
+        if(kFcache)
+            c.kFc = kFcache->col[0];
+        else if(c.need[KFCOL_KF])
+            c.kFnew = (double*) calloc(sizeof(double), len(t));
+    }
+
+    for(j=0; j<ncols; j++) {
+        if(j)
+            CSVWriteString(out, ",");
+        CSVWriteString(out, (char*) KFColHeader[cols[j]]);
+    }
+    CSVWriteString(out, "\n");
+
+    if(tfull) {
+        kFWriteExpanded(&c, tfull, Xfull, cols, ncols, s ? &sum : NULL, out);
+    } else {
+        /* Each thread gets its own copy of the column state, since the flux
+         * values are saved from one row to the next. */
+        nblocks = (len(t) + KFBLOCK-1)/KFBLOCK;
+#pragma omp parallel for ordered schedule(dynamic) firstprivate(c) private(bsum, text, size)
+        for(b=0; b<nblocks; b++) {
+            memset(&bsum, 0, sizeof(kfsums));
+            text = kFBlock(&c, b*KFBLOCK, (b+1)*KFBLOCK < len(t) ? (b+1)*KFBLOCK : len(t),
+                           cols, ncols, s ? &bsum : NULL, job->precision, &size);
+#pragma omp ordered
+            {
+                CSVWriteBytes(out, text, size);
+                sum.nkF += bsum.nkF;
+                sum.kF += bsum.kF;
+                sum.n += bsum.n;
+                sum.x += bsum.x;
+                sum.y += bsum.y;
+                sum.xx += bsum.xx;
+                sum.xy += bsum.xy;
+            }
+            free(text);
+        }
+    }
+    status = DestroyCSVWriter(out);
+
+    if(c.kFnew) {
+        kFCacheSave(job->cache, KFCACHEKF, key, c.kFnew, len(t));
+        free(c.kFnew);
+    }
+    if(kFcache)
+        DestroyCSVTable(kFcache);
+    if(c.dens)
+        DestroyPastaDensity(c.dens);
+
+    if(s) {
+        s->nrows = len(t);
+        s->p0 = p0;
+        s->Xe = Xe;
+        s->kFmean = sum.nkF ? sum.kF/sum.nkF : NAN;
+        s->D0 = s->Dk = NAN;
+        if(sum.n >= 2) {
+            s->Dk = (sum.n*sum.xy - sum.x*sum.y)/(sum.n*sum.xx - sum.x*sum.x);
+            s->D0 = exp((sum.y - s->Dk*sum.x)/sum.n);
+        }
+    }
+
+    return status;
+}
@@ -44,6 +44,33 @@ double CrankEquation(double kf, double t, double X0, double Xe, int nterms)
     return value;
 }
 
+/**
+ * Derivative of the Crank equation with respect to kF.
+ * \f[
+ * \frac{\partial X_{db}}{\partial k_F}
+ *     = -\frac{8}{\pi^2}(X_0-X_e) t \sum_{n=0}^\infty
+ *             \exp\left\{-k_F t (2n+1)^2\right\}
+ * \f]
+ * @param kf Diffusivity constant (D*pi^2/l^2) [1/s]
+ * @param t Time [sec]
+ * @param X0 Initial moisture content [kg/kg db]
+ * @param Xe Equilibrium moisture content [kg/kg db]
+ * @param nterms Number of terms of the equation to calculate
+ * @returns Derivative of moisture content with respect to kF [kg/kg db s]
+ *
+ * @see CrankEquation
+ */
+double CrankEquationDkF(double kf, double t, double X0, double Xe, int nterms)
+{
+    double value = 0; /* Variable for summing up all the terms */
+    int n; /* Current term */
+
+    for(n=0; n<nterms; n++)
+        value += exp(-kf * t * (2*n+1)*(2*n+1));
+
+    return -8/(M_PI*M_PI) * (X0-Xe) * t * value;
+}
+
 /**
  * Equation for sorption/desorption by a membrane
  * @param x X-coordinate in the membrane [m]
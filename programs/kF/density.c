@@ -0,0 +1,124 @@
+/**
+ * @file density.c
+ * Density of the sample as a function of moisture content at a fixed
+ * temperature. The Choi-Okos density is found by adding up the specific volume
+ * of each component, and adding water on a dry basis only changes the mass
+ * fractions, so the specific volume ends up being
+ * \f[
+ * \frac{1}{\rho} = \frac{a + b X_{db}}{1 + X_{db}}
+ * \f]
+ * Once a and b are known, the density can be calculated without making a new
+ * Choi-Okos composition for every data point.
+ */
+
+#include "kf.h"
+#include "proptable.h"
+#include "material-data.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define DENSITYTOL 1e-9 /* How closely the rational form has to match rho */
+#define DENSITYXMAX 1 /* Largest moisture content to tabulate [kg/kg db] */
+
+/**
+ * Density straight from the Choi-Okos equations. This is used to set up the
+ * evaluator, and as the function for the fallback table.
+ * @param X Moisture content [kg/kg db]
+ * @param d Density evaluator (for the dry composition and temperature)
+ * @returns Density [kg/m^3]
+ */
+static double ChoiOkosDensity(double X, void *d)
+{
+    pastadensity *pd = (pastadensity*) d;
+    choi_okos *co;
+    double r;
+
+    co = AddDryBasis(pd->codry, X);
+    r = rho(co, pd->T);
+    DestroyChoiOkos(co);
+
+    return r;
+}
+
+/**
+ * Set up density calculations for a composition at a fixed temperature. The
+ * coefficients are found from the density at zero and one kg/kg db, and then
+ * checked at a few other moisture contents. If the density from the Choi-Okos
+ * equations doesn't have the expected form, a property table is used instead.
+ * @param comp Composition of the dry sample (such as PASTACOMP)
+ * @param T Temperature [K]
+ * @returns Density evaluator
+ */
+pastadensity* CreatePastaDensity(int comp, double T)
+{
+    pastadensity *d;
+    double Xc[] = {.05, .25, .5, 2}, /* Moisture contents to check */
+           r;
+    int i;
+
+    d = (pastadensity*) calloc(sizeof(pastadensity), 1);
+    d->T = T;
+    d->codry = CreateChoiOkos(comp);
+
+    d->a = 1/ChoiOkosDensity(0, d);
+    d->b = 2/ChoiOkosDensity(1, d) - d->a;
+
+    for(i=0; i<4; i++) {
+        r = ChoiOkosDensity(Xc[i], d);
+        if(!(fabs(PastaDensity(d, Xc[i]) - r) <= DENSITYTOL*r)) {
+            d->table = CreatePropTable(&ChoiOkosDensity, d,
+                                       0, DENSITYXMAX, DENSITYTOL);
+            break;
+        }
+    }
+
+    return d;
+}
+
+/**
+ * Free a density evaluator.
+ * @param d Density evaluator to destroy
+ */
+void DestroyPastaDensity(pastadensity *d)
+{
+    if(d->table)
+        DestroyPropTable(d->table);
+    DestroyChoiOkos(d->codry);
+    free(d);
+}
+
+/**
+ * Density of the sample at a moisture content. This does not allocate any
+ * memory.
+ * @param d Density evaluator
+ * @param X Moisture content [kg/kg db]
+ * @returns Density [kg/m^3]
+ */
+double PastaDensity(pastadensity *d, double X)
+{
+    if(d->table)
+        return PropTableVal(d->table, X);
+    return (1+X)/(d->a + d->b*X);
+}
+
+/**
+ * Density of the sample at every moisture content in a vector.
+ * @param d Density evaluator
+ * @param X Vector of moisture contents [kg/kg db]
+ * @returns Vector of densities [kg/m^3]
+ */
+vector* PastaDensityVector(pastadensity *d, vector *X)
+{
+    vector *r;
+    int i;
+
+    if(d->table)
+        return PropTableVector(d->table, X);
+
+    r = CreateVector(len(X));
+    for(i=0; i<len(X); i++)
+        setvalV(r, i, (1+valV(X, i))/(d->a + d->b*valV(X, i)));
+
+    return r;
+}
+
@@ -6,8 +6,32 @@
 #include "kf.h"
 #include "matrix.h"
 #include "material-data.h"
+#include "hereditary.h"
+#include <math.h>
+#include <stdlib.h>
 
-#define NPTS 50 /* Number of points to average the flux over */
+#define FLUXNX 32 /* Number of moisture contents to fit the relaxation function at */
+
+/**
+ * Parameters for the relaxation function used by MomentumFlux.
+ */
+typedef struct {
+    maxwell *m; /* Maxwell parameters */
+    double T, /* Temperature [K] */
+           X; /* Moisture content [kg/kg db] */
+} fluxrelax;
+
+/**
+ * Maxwell relaxation function in the form needed by FitProny.
+ * @param t Time [s]
+ * @param params Pointer to a fluxrelax struct
+ * @returns Relaxation modulus [Pa]
+ */
+static double FluxRelax(double t, void *params)
+{
+    fluxrelax *r = (fluxrelax*) params;
+    return MaxwellRelax(r->m, t, r->T, r->X);
+}
 
 /**
  * Calculate the mass flux of water leaving the surface of the pasta slab.
@@ -43,36 +67,103 @@ vector* MassFlux(int initial, vector *t, vector *Xdb, double Mdry)
     return J;
 }
 
+/**
+ * Calculate the momentum flux at the surface of the slab from the change in
+ * thickness:
+ * \f[
+ * M_i = \sum_{j<i} G(t_i-t_j, X_j) \frac{L_j-L_{j-1}}{L_0}
+ * \f]
+ * The relaxation function is fit to a Prony series at FLUXNX moisture contents
+ * spanning the data, all with the same relaxation times (see
+ * FitPronyDensity), and the amplitudes are interpolated for each point. This
+ * lets the sum be carried forward one point at a time (see HereditaryStep)
+ * instead of being recalculated from scratch at each point.
+ * @param initial Row number of the first data point to consider
+ * @param t Time [s]
+ * @param Xdb Moisture content [kg/kg db]
+ * @param L Slab thickness [m]
+ * @param T Drying temperature [K]
+ * @param m Maxwell parameters
+ * @returns Vector of momentum flux values
+ */
 /* TODO: Double check this function to make sure it's giving good results */
 vector* MomentumFlux(int initial, vector *t,
                      vector *Xdb, vector *L,
                      double T, maxwell *m)
 {
-    vector *M, *tadj;
-    double Mi = 0, /* Set momentum flux to zero initially */
+    vector *M;
+    prony *table[FLUXNX], /* Relaxation function at each moisture content */
+          *p; /* Relaxation function for the current point */
+    hereditary *h; /* State for the momentum flux sum */
+    fluxrelax r = {m, T, 0};
+    double Mi,
            L0,
-           ti;
-    int i, j;
+           dt, dL,
+           Xmin, Xmax, /* Range of moisture contents */
+           tmin, tmax, /* Range of time differences */
+           x, f, /* Position in the table */
+           err; /* Largest error in the fitted relaxation functions */
+    int density, /* Modes per decade in the fitted relaxation functions */
+        i, j, k;
 
     M = CreateVector(len(t));
+    if(initial >= len(t)-1)
+        return M;
     L0 = valV(L, initial);
 
-    tadj = CreateVector(len(t));
-    for(i=0; i<len(tadj); i++)
-        setvalV(tadj, i, valV(t, i)-valV(t, initial));
+    /* Find the range of moisture contents and times the kernel is needed
+     * over */
+    Xmin = Xmax = valV(Xdb, initial);
+    tmin = tmax = valV(t, len(t)-1) - valV(t, initial);
+    for(i=initial+1; i<len(t); i++) {
+        Xmin = fmin(Xmin, valV(Xdb, i));
+        Xmax = fmax(Xmax, valV(Xdb, i));
+        dt = valV(t, i) - valV(t, i-1);
+        if(dt > 0 && dt < tmin)
+            tmin = dt;
+    }
 
-    for(i=initial; i<len(t); i+=1) {
-        ti = valV(tadj, i);
-        for(j=initial; j<i; j++) {
-            Mi += MaxwellRelax(m, ti-valV(tadj, j), T, valV(Xdb, j))
-                * (valV(L, j) - valV(L, j-1)) / L0;
-            //printf("G(t) = %g\t", MaxwellRelax(m, ti, T, val(Xdb, j, 0)));
+    /* Every fit needs the same relaxation times, so they all use the same
+     * number of modes per decade. That's increased until all of them are
+     * within PRONYTOL. */
+    for(density=PRONYDENSITY; ; density *= 2) {
+        err = 0;
+        for(k=0; k<FLUXNX; k++) {
+            r.X = Xmin + (Xmax-Xmin)*k/(FLUXNX-1);
+            table[k] = FitPronyDensity(&FluxRelax, &r, tmin, tmax, density);
+            err = fmax(err, table[k]->err);
         }
-
-        for(j=i-1; j<i; j++)
-            setvalV(M, j, Mi/1);
-        Mi = 0;
+        if(err <= PRONYTOL || 2*density > PRONYMAXDENSITY)
+            break;
+        for(k=0; k<FLUXNX; k++)
+            DestroyProny(table[k]);
     }
+    p = CopyProny(table[0]);
+    h = CreateHereditary(p);
+
+    for(i=initial; i<len(t); i++) {
+        dt = (i > initial) ? valV(t, i) - valV(t, i-1) : 0;
+        dL = (i > 0) ? valV(L, i) - valV(L, i-1) : 0;
+
+        /* Interpolate the Prony amplitudes at this moisture content */
+        x = (Xmax > Xmin) ? (FLUXNX-1)*(valV(Xdb, i)-Xmin)/(Xmax-Xmin) : 0;
+        j = (int) x;
+        if(j > FLUXNX-2)
+            j = FLUXNX-2;
+        f = x - j;
+        p->ginf = (1-f)*table[j]->ginf + f*table[j+1]->ginf;
+        for(k=0; k<p->n; k++)
+            p->g[k] = (1-f)*table[j]->g[k] + f*table[j+1]->g[k];
+
+        Mi = HereditaryStep(h, p, dt, dL/L0);
+        if(i > initial)
+            setvalV(M, i-1, Mi);
+    }
+
+    for(k=0; k<FLUXNX; k++)
+        DestroyProny(table[k]);
+    DestroyProny(p);
+    DestroyHereditary(h);
 
     return M;
 }
@@ -0,0 +1,280 @@
+/**
+ * @file follow.c
+ * Follow an IGASorp data file that is still being written and calculate kF for
+ * each new row as it shows up. Everything here is updated incrementally, so
+ * each update only costs as much as the number of new rows.
+ */
+
+#include "kf.h"
+#include "matrix.h"
+#include "material-data.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define FOLLOWRHTOL 0.05 /* How close to the average RH we need to be */
+#define FOLLOWMINPTS 10 /* Points needed before Xe is estimated */
+#define FOLLOWFORGET 0.995 /* Weight given to older points in the Xe estimate */
+#define FOLLOWPOLL 5 /* Seconds to wait between checks for new data */
+#define FOLLOWIDLE 600 /* Quit after this many seconds without new data */
+
+/**
+ * Set up everything needed to follow a data file.
+ * @param file Name of the (converted) IGASorp data file
+ * @param Mdry Mass of the bone dry sample [mg]
+ * @param L0 Initial thickness [m]
+ * @param T Drying temperature [K]
+ * @param Xe Equilibrium moisture content [kg/kg db]. If this is negative, it
+ *      is estimated from the data as it comes in.
+ * @returns Follow state, or NULL if the file can't be opened.
+ */
+kffollow* CreatekFFollow(char *file, double Mdry, double L0, double T, double Xe)
+{
+    kffollow *f;
+
+    f = (kffollow*) calloc(sizeof(kffollow), 1);
+    f->in = fopen(file, "r");
+    if(!f->in) {
+        free(f);
+        return NULL;
+    }
+
+    f->Mdry = Mdry;
+    f->L0 = L0;
+    f->T = T;
+    f->Xe = Xe;
+    f->fixedXe = (Xe >= 0);
+    f->dens = CreatePastaDensity(PASTACOMP, T);
+    f->Dtab = DiffCh10Table(T);
+
+    return f;
+}
+
+/**
+ * Close the input file and free the follow state.
+ * @param f Follow state to destroy
+ */
+void DestroykFFollow(kffollow *f)
+{
+    fclose(f->in);
+    DestroyPastaDensity(f->dens);
+    free(f->line);
+    free(f);
+}
+
+/**
+ * Start a new stable region at the current row. This is the incremental
+ * version of FindInitialPointRH: instead of comparing against the average
+ * humidity for the whole run, each row is compared against the average of the
+ * rows since the last change in humidity.
+ * @param f Follow state
+ * @param X Moisture content at the new starting row [kg/kg db]
+ */
+static void ResetInitialPoint(kffollow *f, double X)
+{
+    f->p0 = f->nrows;
+    f->RHsum = 0;
+    f->RHn = 0;
+
+    /* Density at the start of the region, used for shrinkage */
+    f->rho0 = PastaDensity(f->dens, X);
+
+    /* The Xe estimate only uses data from the stable region */
+    f->n = 0;
+    f->S = 0;
+    f->Sx = 0;
+    f->Sy = 0;
+    f->Sxx = 0;
+    f->Sxy = 0;
+    if(!f->fixedXe)
+        f->Xe = -1;
+}
+
+/**
+ * Update the equilibrium moisture content estimate with a new data point.
+ * After the initial transient, drying follows
+ * \f$\frac{dX}{dt} = -k(X-X_e)\f$, so a linear fit of \f$\frac{dX}{dt}\f$
+ * against \f$X\f$ has slope \f$-k\f$ and intercept \f$kX_e\f$. The sums for
+ * that fit are kept as running totals, so each update is O(1). Older points
+ * are gradually forgotten so that the early part of the curve, where the
+ * higher order terms of the Crank equation still matter, doesn't bias the
+ * estimate.
+ * @param f Follow state
+ * @param t Time [s]
+ * @param X Moisture content [kg/kg db]
+ */
+static void UpdateXe(kffollow *f, double t, double X)
+{
+    double x, y, slope, intercept;
+
+    if(f->nrows == f->p0 || t == f->tp)
+        return;
+
+    x = (X + f->Xp)/2;
+    y = (X - f->Xp)/(t - f->tp);
+
+    f->n++;
+    f->S = FOLLOWFORGET*f->S + 1;
+    f->Sx = FOLLOWFORGET*f->Sx + x;
+    f->Sy = FOLLOWFORGET*f->Sy + y;
+    f->Sxx = FOLLOWFORGET*f->Sxx + x*x;
+    f->Sxy = FOLLOWFORGET*f->Sxy + x*y;
+
+    if(f->fixedXe || f->n < FOLLOWMINPTS)
+        return;
+
+    slope = (f->S*f->Sxy - f->Sx*f->Sy)/(f->S*f->Sxx - f->Sx*f->Sx);
+    intercept = (f->Sy - slope*f->Sx)/f->S;
+
+    /* Only accept the estimate if the sample is actually drying */
+    if(slope < 0)
+        f->Xe = -intercept/slope;
+}
+
+/**
+ * Process one row of data and write the results to the output file.
+ * @param f Follow state
+ * @param out csv writer for the output file
+ * @param tmin Time [min]
+ * @param M Sample mass [mg]
+ * @param RH Relative humidity [%]
+ */
+static void FollowRow(kffollow *f, csvwriter *out, double tmin, double M, double RH)
+{
+    double t = 60*tmin, /* Convert to seconds */
+           X = (M - f->Mdry)/f->Mdry,
+           kFi = NAN,
+           rhoi,
+           row[5]; /* Values to write */
+
+    if(f->nrows == 0) {
+        f->X0 = X;
+        ResetInitialPoint(f, X);
+    } else if(f->RHn > 0 && fabs(RH - f->RHsum/f->RHn) > FOLLOWRHTOL) {
+        ResetInitialPoint(f, X);
+    }
+    f->RHsum += RH;
+    f->RHn++;
+
+    UpdateXe(f, t, X);
+    f->tp = t;
+    f->Xp = X;
+
+    /* Same as calckf: each point is relative to the first row */
+    if(f->Xe >= 0 && f->Xe < X)
+        kFi = CrankkF(t, X, f->X0, f->Xe, BETA0);
+
+    /* Same as LengthDensityChange */
+    rhoi = PastaDensity(f->dens, X);
+
+    row[0] = t;
+    row[1] = X;
+    row[2] = kFi;
+    row[3] = f->rho0/rhoi * f->L0;
+    row[4] = DiffCh10Tab(f->Dtab, X, f->T);
+    CSVWriteRow(out, row, 5);
+
+    f->nrows++;
+}
+
+/**
+ * Read any complete rows that have been added to the file since the last
+ * update and write the results for them. A partially written line at the end
+ * of the file is left for the next update. Lines can be any length; the line
+ * buffer grows to fit them.
+ * @param f Follow state
+ * @param out csv writer for the output file
+ * @returns Number of data rows processed
+ */
+int kFFollowUpdate(kffollow *f, csvwriter *out)
+{
+    double tmin, M, RH;
+    long pos;
+    ssize_t len; /* Length of the line read */
+    int n = 0;
+
+    /* Clear the EOF flag so that newly appended data can be read */
+    clearerr(f->in);
+    fseek(f->in, f->offset, SEEK_SET);
+
+    while(pos = ftell(f->in),
+          (len = getline(&f->line, &f->linesize, f->in)) > 0) {
+        /* Incomplete line. Back up and wait for the rest of it. */
+        if(f->line[len-1] != '\n') {
+            fseek(f->in, pos, SEEK_SET);
+            break;
+        }
+        f->offset = ftell(f->in);
+
+        if(f->nlines++ < IGASORPROW0)
+            continue;
+        if(sscanf(f->line, "%lf,%lf,%lf", &tmin, &M, &RH) != 3)
+            continue;
+
+        FollowRow(f, out, tmin, M, RH);
+        n++;
+    }
+    CSVFlush(out);
+    fflush(out->fp);
+
+    return n;
+}
+
+/**
+ * Follow an IGASorp file while it is being written. The output file is
+ * created with a header, and results for new rows are appended to it as they
+ * become available. This returns once no new data has shown up for
+ * FOLLOWIDLE seconds.
+ * @param infile Name of the (converted) IGASorp data file
+ * @param outfile Name of the file to write results to
+ * @param Mdry Mass of the bone dry sample [mg]
+ * @param L0 Initial thickness [m]
+ * @param T Drying temperature [K]
+ * @param Xe Equilibrium moisture content [kg/kg db], or negative to estimate it
+ * @param precision Significant digits to save, or 0 for the shortest exact
+ *      value
+ * @returns Total number of rows processed, or -1 on error.
+ */
+int kFFollow(char *infile, char *outfile,
+             double Mdry, double L0, double T, double Xe, int precision)
+{
+    kffollow *f;
+    csvwriter *out;
+    int n, idle = 0;
+
+    f = CreatekFFollow(infile, Mdry, L0, T, Xe);
+    if(!f) {
+        fprintf(stderr, "Unable to open %s\n", infile);
+        return -1;
+    }
+    out = CreateCSVWriter(outfile, precision, 0);
+    if(!out) {
+        fprintf(stderr, "Unable to open %s\n", outfile);
+        DestroykFFollow(f);
+        return -1;
+    }
+    CSVWriteString(out, "Time [s],Moisture Content [kg/kg db],kF,Thickness [m],D [m^2/s]\n");
+
+    while(idle < FOLLOWIDLE) {
+        n = kFFollowUpdate(f, out);
+        if(n > 0) {
+            idle = 0;
+            printf("Row %d: p0 = %d, Xe = %g\n", f->nrows, f->p0, f->Xe);
+            fflush(stdout);
+        } else {
+            sleep(FOLLOWPOLL);
+            idle += FOLLOWPOLL;
+        }
+    }
+
+    n = f->nrows;
+    if(DestroyCSVWriter(out)) {
+        fprintf(stderr, "Unable to write %s\n", outfile);
+        n = -1;
+    }
+    DestroykFFollow(f);
+
+    return n;
+}
@@ -5,32 +5,37 @@
 
 #include "kf.h"
 #include "matrix.h"
+#include "csv.h"
+#include "colfile.h"
 
 /**
  * Load the time data from an IGASorp data file. The file needs to be converted
  * to a CSV file before loading. The header at the top of the file is ignored,
  * but the values must be separated by commas.
  * @param file The name of the file to open.
- * @returns A vector of times [s]
+ * @returns A vector of times [s], or NULL if the file can't be loaded
  */
 vector* LoadIGASorpTime(char *file)
 {
-    int row0 = 17, /* First row that contains numbers */
-        col = 0; /* Get mass data from column 1 */
-    matrix *data; /* Raw data loaded from the file */
-    vector *min, /* Time in minutes */
-           *t; /* Time data in seconds */
-
-    /* Load the data file and extract the column containing time */
-    data = mtxloadcsv(file, row0);
-    min = ExtractColumnAsVector(data, col);
-
-    /* Convert from minutes to seconds */
-    t = scalarmultV(60, min);
+    int row0 = IGASORPROW0, /* First row that contains numbers */
+        col = 0, /* Get time data from column 1 */
+        i; /* Loop index */
+    csvtable *data; /* Raw data loaded from the file */
+    vector *t; /* Time data in seconds */
+
+    /* Load the data file and convert the time column from minutes to
+     * seconds */
+    data = CSVLoadCached(file, row0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return NULL;
+    }
+    t = CreateVector(data->nrows);
+    for(i=0; i<data->nrows; i++)
+        setvalV(t, i, 60*csvval(data, i, col));
 
     /* Clean up */
-    DestroyMatrix(data);
-    DestroyVector(min);
+    DestroyCSVTable(data);
 
     return t;
 }
@@ -42,30 +47,31 @@ vector* LoadIGASorpTime(char *file)
  * the values must be separated by commas.
  * @param file The name of the file to open.
  * @param Mdry The bone dry mass of the sample [mg]
- * @returns A vector of moisture content values [kg/kg db]
+ * @returns A vector of moisture content values [kg/kg db], or NULL if the
+ *      file can't be loaded
  */
 vector* LoadIGASorpXdb(char *file, double Mdry)
 {
-    int row0 = 17, /* First row that contains numbers */
+    int row0 = IGASORPROW0, /* First row that contains numbers */
         col = 1, /* Get mass data from column 2 */
         i; /* Loop index */
-    matrix *data; /* Raw data from CSV file */
-    vector *M, /* Mass of sample [mg] */
-           *Xdb; /* Calculate moisture content [kg/kg db] */
+    csvtable *data; /* Raw data from CSV file */
+    vector *Xdb; /* Calculate moisture content [kg/kg db] */
 
-    /* Load the data and pull out the relevant column */
-    data = mtxloadcsv(file, row0);
-    M = ExtractColumnAsVector(data, col);
-    /* Make a matrix to hold the moisture content values */
-    Xdb = CreateVector(len(M));
+    /* Load the data and make a vector to hold the moisture content values */
+    data = CSVLoadCached(file, row0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return NULL;
+    }
+    Xdb = CreateVector(data->nrows);
 
     /* Calculate moisture content based on mass and bone dry mass */
-    for(i=0; i<len(M); i++)
-        setvalV(Xdb, i, (valV(M, i)-Mdry)/Mdry);
+    for(i=0; i<data->nrows; i++)
+        setvalV(Xdb, i, (csvval(data, i, col)-Mdry)/Mdry);
 
     /* Clean up */
-    DestroyVector(M);
-    DestroyMatrix(data);
+    DestroyCSVTable(data);
 
     return Xdb;
 }
@@ -75,22 +81,65 @@ vector* LoadIGASorpXdb(char *file, double Mdry)
  * to a CSV file before loading. The header at the top of the file is ignored,
  * but the values must be separated by commas.
  * @param file The name of the file to open.
- * @returns A vector of times [s]
+ * @returns A vector of relative humidities [%], or NULL if the file can't be
+ *      loaded
  */
 vector* LoadIGASorpRH(char *file)
 {
-    int row0 = 17, /* First row that contains numbers */
+    int row0 = IGASORPROW0, /* First row that contains numbers */
         col = 2; /* Get humidity data from column 3 */
-    matrix *data; /* Raw data loaded from the file */
+    csvtable *data; /* Raw data loaded from the file */
     vector *RH;
 
     /* Load the data file and extract the column containing humidity */
-    data = mtxloadcsv(file, row0);
-    RH = ExtractColumnAsVector(data, col);
+    data = CSVLoadCached(file, row0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return NULL;
+    }
+    RH = CSVColumnVector(data, col);
 
     /* Clean up */
-    DestroyMatrix(data);
+    DestroyCSVTable(data);
 
     return RH;
 }
 
+/**
+ * Load time, moisture content, and relative humidity from an IGASorp data file
+ * all at once. This only reads the file once, instead of once for each
+ * column.
+ * @param file The name of the file to open.
+ * @param Mdry The bone dry mass of the sample [mg]
+ * @param t Set to a vector of times [s]
+ * @param Xdb Set to a vector of moisture contents [kg/kg db]
+ * @param RH Set to a vector of relative humidities [%]
+ * @returns 0 on success, or 1 if the file can't be loaded (the vectors are
+ *      left unset)
+ */
+int LoadIGASorp(char *file, double Mdry, vector **t, vector **Xdb, vector **RH)
+{
+    int row0 = IGASORPROW0, /* First row that contains numbers */
+        i; /* Loop index */
+    csvtable *data; /* Raw data from CSV file */
+
+    data = CSVLoadCached(file, row0);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return 1;
+    }
+
+    *t = CreateVector(data->nrows);
+    *Xdb = CreateVector(data->nrows);
+    *RH = CreateVector(data->nrows);
+    for(i=0; i<data->nrows; i++) {
+        setvalV(*t, i, 60*csvval(data, i, 0));
+        setvalV(*Xdb, i, (csvval(data, i, 1)-Mdry)/Mdry);
+        setvalV(*RH, i, csvval(data, i, 2));
+    }
+
+    DestroyCSVTable(data);
+
+    return 0;
+}
+
@@ -13,100 +13,206 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 int main(int argc, char *argv[])
 {
-    vector *t, /* Time vector [s] */
-           *X, /* Moisture content [kg/kg db] */
-           *RH, /* Relative humidity [%] */
-           *kF, /* kF value [-] */
-           *L, /* Thickness (from kF + diffusivity model) [m] */
-           *De, /* Deborah Number [-] */
-           *Lwat, /* Thickness (from volume of water lost) [m] */
-           *Diff, /* Diffusivity [m/s^2] */
-           *MFlux,
-           *MomeFlux,
-           *Lconst; /* Thickness (from kF, constant diffusivity) [m] */
-    matrix *data; /* Matrix of data for output */
-    int p0; /* Initial data point */
-    double Xe, /* Equilibrium moisture content [kg/kg db]*/
-           Mdry, /* Mass of dry sample [g] */
-           L0 = 6.22e-4, /* Initial slab thickness [m] */
-           T = 60+273.15; /* Drying temperature [K] */
-    char *outfile; /* Filename to output data to */
-    maxwell *m; /* Set of maxwell data for calculating Deborah number */
-    m = CreateMaxwell();
-    /* Allocate memory for the output filename */
-    outfile = (char*) calloc(sizeof(char), 80);
+    kfjob job, /* Data file and sample parameters */
+          *jobs; /* List of jobs to run in batch mode */
+    double T = 60+273.15, /* Drying temperature [K] */
+           steptol = 0, /* RH tolerance for splitting the run into steps */
+           dectol = 0; /* Moisture content tolerance for decimating the data */
+    char *outfile, /* Filename to output data to */
+         *manifest = NULL, /* List of files to process in batch mode */
+         *columns = NULL, /* Columns to save to the output file */
+         *cache = KFCACHEDIR; /* Directory to cache results in */
+    int follow = 0, /* Set to follow a file that is still being written */
+        cachedir = 0, /* Set if a cache directory was given with -C */
+        window = 0, /* Number of points in the sliding kF window */
+        stride = 1, /* Number of points to move the window each step */
+        nthreads = 0, /* Number of threads to use in batch mode */
+        precision = 0, /* Significant digits to save (0 for the shortest exact value) */
+        expand = 0, /* Set to expand decimated results back out to every row */
+        njobs, /* Number of jobs in the manifest */
+        *cols, /* Columns parsed from the -c option */
+        ncols, /* Number of columns */
+        status, /* Return value */
+        i, /* Loop index */
+        opt; /* Command line option */
+
+    /* Parse any command line options */
+    while((opt = getopt(argc, argv, "fw:b:j:s:c:p:nC:d:e")) != -1) {
+        switch(opt) {
+            case 'f':
+                follow = 1;
+                break;
+            case 'w':
+                sscanf(optarg, "%d,%d", &window, &stride);
+                break;
+            case 'b':
+                manifest = optarg;
+                break;
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+            case 's':
+                steptol = atof(optarg);
+                break;
+            case 'c':
+                columns = optarg;
+                break;
+            case 'p':
+                precision = atoi(optarg);
+                break;
+            case 'n':
+                cache = NULL;
+                break;
+            case 'C':
+                cache = optarg;
+                cachedir = 1;
+                break;
+            case 'd':
+                dectol = atof(optarg);
+                break;
+            case 'e':
+                expand = 1;
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+    /* Shift the remaining arguments so that argv[1] is the data file */
+    argc -= optind-1;
+    argv += optind-1;
 
     /* If a filename isn't supplied, spit out usage info and exit */
-    if(argc < 3) {
+    if(argc < 4 && !(manifest && argc >= 1)) {
         puts("Usage:");
-        puts("kF <datafile.csv> <Mdry> <Xe>");
+        puts("kF [-j <threads>] [-w <n>[,<stride>]] [-c <columns>] [-p <digits>] [-d <tol> [-e]] [-n | -C <dir>] <datafile.csv> <Mdry> <L0> <Xe>");
+        puts("kF -f [-p <digits>] <datafile.csv> <Mdry> <L0> <Xe>");
+        puts("kF -s <tol> [-d <tol>] [-n | -C <dir>] <datafile.csv> <Mdry> <L0> <Xe>");
+        puts("kF -b <manifest.csv> [-j <threads>] [-w <n>[,<stride>]] [-c <columns>] [-p <digits>] [-d <tol> [-e]] [-n | -C <dir>]");
+        puts("-f: Follow the data file while it is still being written. Only");
+        puts("    -p can be used with this, and nothing is cached. If Xe isn't");
+        puts("    given, it is estimated from a running fit of dX/dt against X");
+        puts("    instead of the fit used otherwise, so it can differ slightly.");
+        puts("-w: Also fit kF over a sliding window of n points.");
+        puts("-b: Process every file listed in the manifest. Each line has the");
+        puts("    form: datafile.csv,Mdry,L0[,Xe]");
+        puts("-j: Number of threads to use. In batch mode, this is the number of");
+        puts("    files to process at once.");
+        puts("-s: Split the run into steps of constant RH (within tol %) and");
+        puts("    analyze each one separately. Equilibrium moisture content for");
+        puts("    each step is saved to Xe<datafile.csv>.");
+        puts("-c: Comma separated list of columns to save. Choices are:");
+        PrintkFColumns();
+        puts("-p: Number of significant digits to save. By default, every value");
+        puts("    is saved with just enough digits to read back exactly.");
+        puts("-d: Drop rows that can be interpolated from their neighbors to");
+        puts("    within tol (in kg/kg db) before analyzing the data. The MFlux");
+        puts("    and PFlux columns can't be used with this.");
+        puts("-e: Interpolate the results from -d back out to every row.");
+        puts("-n: Don't cache results. Normally, Xe and kF are saved to " KFCACHEDIR);
+        puts("    in the current directory and reused the next time the same");
+        puts("    data is analyzed. Nothing is ever removed from the cache;");
+        puts("    delete the directory to clear it.");
+        puts("-C: Directory to cache results in.");
         puts("datafile.csv: The file to load data from.");
         puts("Mdry: The mass of the dry sample. (in g)");
         puts("L0: Initial thickness (in mm)");
         puts("Xe: Optionally supply the equilibrium moisture content.");
         puts("");
-        puts("Output is saved to kF<datafile.csv>.");
+        puts("Output is saved to kF<datafile.csv>. In batch mode, a summary of");
+        puts("all the files is saved to kF<manifest.csv>.");
         return 0;
     }
 
-    /* Pull the dry mass from the command line arguments */
-    Mdry = atof(argv[2]);
-    L0 = atof(argv[3])/1000; /* Convert to meters for calculations */
-
-    /* Load all the important information from the IGASorp file.*/
-    t = LoadIGASorpTime(argv[1]);
-    X = LoadIGASorpXdb(argv[1], Mdry);
-    RH = LoadIGASorpRH(argv[1]);
+    /* Check the column list up front, rather than failing on every file */
+    if(columns) {
+        cols = ParsekFColumns(columns, &ncols);
+        if(!cols) {
+            fprintf(stderr, "Run kF with no arguments for the list of columns.\n");
+            return 1;
+        }
+        free(cols);
+    }
 
-    /* Determine the first point to use for equilibrium moisture
-     * content and similar calculations. Values will be calculated
-     * for rows before this, but they should be disregarded.
-     */
-    p0 = FindInitialPointRH(RH);
-    //p0 = 0;
-    printf("Starting calculations from row %d.\n", p0);
+    /* Follow mode writes a fixed set of columns as each row comes in, so
+     * none of the options that change what gets calculated apply */
+    if(follow && (manifest || steptol > 0 || window > 0 || columns
+                  || dectol > 0 || expand || nthreads > 0 || !cache || cachedir)) {
+        fprintf(stderr, "Only -p can be used with -f\n");
+        return 1;
+    }
 
-    /* If equilibrium moisture content is supplied, use that value.
-     * Otherwise, calculate Xe iteratively. In either case, print out the
-     * value. */
-    if(argc == 5)
-        Xe = atof(argv[4]);
-    else
-        Xe = CalcXeIt(p0, t, X, valV(X, len(X)-1)*.95);
-    printf("Xe = %g\n", Xe);
+    /* Process a whole list of files */
+    if(manifest) {
+        jobs = LoadManifest(manifest, T, &njobs);
+        if(!jobs) {
+            fprintf(stderr, "Unable to open %s\n", manifest);
+            return 1;
+        }
+        for(i=0; i<njobs; i++) {
+            jobs[i].window = window;
+            jobs[i].stride = stride;
+            jobs[i].columns = columns;
+            jobs[i].precision = precision;
+            jobs[i].cache = cache;
+            jobs[i].dectol = dectol;
+            jobs[i].expand = expand;
+        }
+        outfile = kFOutputName(manifest);
+        status = kFBatch(jobs, njobs, nthreads, outfile);
+        printf("Processed %d files (%d failed). Summary saved to %s\n",
+               njobs, status, outfile);
+        PrintkFCacheStats(cache);
+        DestroyManifest(jobs, njobs);
+        free(outfile);
+        return status != 0;
+    }
 
-    /* Create the filename for the output csv file. It is always
-     * kF prepended to the supplied input filename. */
-    sprintf(outfile, "kF%s", argv[1]);
+#ifdef _OPENMP
+    if(nthreads > 0)
+        omp_set_num_threads(nthreads);
+#endif
 
-    /* Calculate kF (ratio of diffusivity to length squared) */
-    kF = calckf(t, X, Xe);
-    /* Determine the length from the kF value and the diffusivity model */
-    //L = LengthMatrix(p0, X, kF, L0, T);
-    /* Deborah Number */
-    //De = DeborahMatrix(p0, X, kF, L0, T, m);
-    /* Length change due solely to volume of water lost */
-    Lwat = LengthDensityChange(p0, X, L0, Mdry*1e-6, T);
-    /* Length change from kF assuming constant diffusivity */
-    //Lconst = LengthConstD(p0, kF, L0, T);
-    /* Diffusivity (from model) */
-    Diff = DOswinVector(p0, X, T);
-    //MFlux = MassFlux(p0, t, X, Mdry*1e-6);
-    //MomeFlux = PastaMassFlux(p0, t, L, L0, T);
+    job.file = argv[1];
+    /* Pull the dry mass from the command line arguments */
+    job.Mdry = atof(argv[2]);
+    job.L0 = atof(argv[3])/1000; /* Convert to meters for calculations */
+    /* If equilibrium moisture content is supplied, use that value.
+     * Otherwise, it's calculated from the data. */
+    job.Xe = (argc == 5) ? atof(argv[4]) : -1;
+    job.T = T;
+    job.window = window;
+    job.stride = stride;
+    job.columns = columns;
+    job.precision = precision;
+    job.cache = cache;
+    job.dectol = dectol;
+    job.expand = expand;
+    job.Dtab = NULL;
 
-    /* Combine all of the vectors for output */
-    //data = CatColVector(10, t, X, kF, L, De, Lwat, Lconst, Diff, MFlux, MomeFlux);
+    /* In follow mode, everything is calculated incrementally as new rows are
+     * added to the data file. */
+    if(follow) {
+        outfile = kFOutputName(job.file);
+        status = kFFollow(job.file, outfile, job.Mdry, job.L0, job.T, job.Xe,
+                          job.precision);
+        free(outfile);
+        return status < 0;
+    }
 
-    /* Write the calculated values to a csv file. */
-    //mtxprntfilehdr(data, outfile, "Time [s],Moisture Content [kg/kg db],kF,Thickness [m],Deborah Number,Shrinkage (Water Loss),,Diffusivity,Mass Flux,Momentum Flux\n");
-    data = CatColVector(5, t, X, kF, Lwat, Diff);
-    mtxprntfilehdr(data, outfile, "Time [s],Moisture Content [kg/kg db],kF,Thickness [m],D [m^2/s]");
-    DestroyMatrix(data);
-    //DestroyMaxwell(m);
+    /* Analyze each humidity step separately */
+    if(steptol > 0)
+        status = kFRunSteps(&job, steptol);
+    else
+        status = kFRun(&job, NULL);
+    PrintkFCacheStats(cache);
 
-    return 0;
+    return status;
 }
-
@@ -1,8 +1,12 @@
 #ifndef KF_H
 #define KF_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include "matrix.h"
 #include "material-data.h"
+#include "proptable.h"
+#include "csv.h"
 
 #define CONSTX0 0
 #define CONSTXe 18.261700
@@ -12,28 +16,140 @@
 #define SLABWIDTH 6e-3
 #define SLABLENGTH 8e-3
 
+#define NPTS 50 /* Number of points to average the flux over */
+#define IGASORPROW0 17 /* First row of an IGASorp data file that contains numbers */
+
+#define KFCACHEDIR ".kFcache" /* Default directory for cached results */
+#define KFCACHEKF "kF" /* Cache stage for kF at every row (see kFCacheKeykF) */
+#define FNVINIT UINT64_C(0xcbf29ce484222325) /* Starting value for FNV1a */
+
+/* Columns that can be saved to the output file (see ParsekFColumns) */
+#define KFCOL_T 0 /* Time [s] */
+#define KFCOL_X 1 /* Moisture content [kg/kg db] */
+#define KFCOL_KF 2 /* kF [1/s] */
+#define KFCOL_KFW 3 /* kF fit over a sliding window [1/s] */
+#define KFCOL_L 4 /* Thickness from kF and the diffusivity model [m] */
+#define KFCOL_DE 5 /* Deborah number [-] */
+#define KFCOL_LWAT 6 /* Thickness from density change [m] */
+#define KFCOL_LCONST 7 /* Thickness from kF assuming constant D [m] */
+#define KFCOL_D 8 /* Diffusivity from the model [m^2/s] */
+#define KFCOL_MFLUX 9 /* Mass flux of water [kg/(m^2 s)] */
+#define KFCOL_PFLUX 10 /* Mass flux of pasta [kg/(m^2 s)] */
+#define KFNCOLS 11
+
+/**
+ * Data file and sample parameters for one run of the kF analysis.
+ * @see kFRun
+ */
+typedef struct {
+    char *file; /* IGASorp data file (converted to CSV) */
+    double Mdry, /* Bone dry mass [mg] */
+           L0, /* Initial thickness [m] */
+           Xe, /* Equilibrium moisture content, or negative to calculate it */
+           T; /* Drying temperature [K] */
+    int window, /* Points in the sliding kF window (zero to skip it) */
+        stride, /* Points to move the sliding window each step */
+        precision, /* Significant digits to output, or 0 for the shortest exact value */
+        expand; /* Set to expand decimated results back out to every row */
+    double dectol; /* Tolerance for decimating the data, or 0 to use every row */
+    char *columns, /* Columns to output, or NULL for the default ones */
+         *cache; /* Directory for cached results, or NULL to not use one */
+    proptable *Dtab; /* Diffusivity table at T, set when the run starts */
+} kfjob;
+
+/**
+ * Summary of the results from one run of the kF analysis.
+ * @see kFRun
+ */
+typedef struct {
+    int nrows, /* Number of data points */
+        p0; /* Initial data point */
+    double Xe, /* Equilibrium moisture content [kg/kg db] */
+           kFmean, /* Average kF after the initial point [1/s] */
+           D0, /* Fitted diffusivity at zero moisture content [m^2/s] */
+           Dk; /* Fitted exponent for D = D0*exp(Dk*X) [kg db/kg] */
+} kfsummary;
+
+/**
+ * A section of a run where the relative humidity is constant.
+ * @see SegmentRH
+ */
+typedef struct {
+    int start, /* First row of the step */
+        end; /* One past the last row of the step */
+    double RH; /* Average relative humidity during the step [%] */
+} rhstep;
+
+/**
+ * Density of the sample at a fixed temperature.
+ * @see CreatePastaDensity
+ */
+typedef struct {
+    double T, /* Temperature [K] */
+           a, b; /* Coefficients for the specific volume, (a+bX)/(1+X) */
+    choi_okos *codry; /* Dry composition */
+    proptable *table; /* Density table, if the coefficients can't be used */
+} pastadensity;
+
+/**
+ * State used to follow an IGASorp file that is still being written.
+ * @see kFFollow
+ */
+typedef struct {
+    FILE *in; /* Data file being followed */
+    long offset; /* Position after the last complete line read */
+    char *line; /* Line buffer, grown to fit the longest line so far */
+    size_t linesize; /* Size of the line buffer */
+    int nlines, /* Lines read so far (including the header) */
+        nrows; /* Data rows processed so far */
+    double Mdry, /* Bone dry mass [mg] */
+           L0, /* Initial thickness [m] */
+           T, /* Drying temperature [K] */
+           X0; /* Moisture content at the first row [kg/kg db] */
+    pastadensity *dens; /* Density of the sample */
+    proptable *Dtab; /* Diffusivity table at T (see DiffCh10Table) */
+
+    /* Stable humidity region */
+    int p0; /* First row of the current stable region */
+    double RHsum; /* Sum of RH values since p0 */
+    int RHn; /* Number of rows since p0 */
+    double rho0; /* Density at p0 [kg/m^3] */
+
+    /* Equilibrium moisture content */
+    int fixedXe; /* Set if Xe was supplied */
+    double Xe, /* Current estimate of Xe (negative if unknown) */
+           tp, Xp; /* Previous time and moisture content */
+    int n; /* Number of points in the dX/dt vs X regression */
+    double S, Sx, Sy, Sxx, Sxy; /* Weighted running sums for the regression */
+} kffollow;
+
 double CrankEquation(double, double, double, double, int);
+double CrankEquationDkF(double, double, double, double, int);
 double CrankkF(double, double, double, double, double);
 double CrankModel(double, matrix*);
 
 vector* LoadIGASorpTime(char*);
 vector* LoadIGASorpXdb(char*, double);
 vector* LoadIGASorpRH(char*);
+int LoadIGASorp(char*, double, vector**, vector**, vector**);
 
 double CalcXe(int, matrix*, matrix*, double);
 double NCalcXe(int, vector*, vector*, double);
-double CalcXeIt(int, vector*, vector*, double);
+double XeRSquared(int, vector*, vector*, vector*, double, double*, double*, double*);
+double CalcXeIt(int, vector*, vector*, vector*, double);
 
 double fitsubset(matrix*, matrix*, int, int);
 vector* calckf(vector*, vector*, double);
 matrix* calckfstep(matrix*, matrix*, double);
 matrix* fitkf(matrix*, matrix*);
+vector* slidekf(vector*, vector*, double, int, int);
 
 int FindInitialPointkF(vector*);
 int FindInitialPointRH(vector*);
 
-double DeborahNumber(int, int, vector*, vector*, double, double, maxwell*);
-double NewLength(int, int, vector*, vector*, double, double);
+double DeborahNumber(int, int, vector*, vector*, double, double, proptable*,
+                     maxwell*);
+double NewLength(int, int, vector*, vector*, double, double, proptable*);
 vector* DeborahMatrix(int, vector*, vector*, double, double, maxwell*);
 vector* LengthMatrix(int, vector*, vector*, double, double);
 vector* LengthConstD(int, vector*, double, double);
@@ -41,9 +157,49 @@ vector* LengthWaterLoss(int, vector*, double, double, double);
 vector* LengthDensityChange(int, vector*, double, double, double);
 vector* DOswinVector(int, vector*, double);
 
+pastadensity* CreatePastaDensity(int, double);
+void DestroyPastaDensity(pastadensity*);
+double PastaDensity(pastadensity*, double);
+vector* PastaDensityVector(pastadensity*, vector*);
+
+proptable* DiffCh10Table(double);
+double DiffCh10Tab(proptable*, double, double);
+
 vector* MassFlux(int, vector*, vector*, double);
 vector* MomentumFlux(int, vector*, vector*, vector*, double, maxwell*);
 vector* PastaMassFlux(int, vector*, vector*, double, double);
 
+int* ParsekFColumns(char*, int*);
+void PrintkFColumns();
+int kFWriteColumns(kfjob*, vector*, vector*, vector*, vector*, vector*,
+                   vector*, int, double, int*, int, char*, kfsummary*);
+
+char* PrefixFileName(char*, char*);
+char* kFOutputName(char*);
+int kFDecimate(double, int, vector**, vector**, vector**);
+int kFRun(kfjob*, kfsummary*);
+
+kfjob* LoadManifest(char*, double, int*);
+void DestroyManifest(kfjob*, int);
+int kFBatch(kfjob*, int, int, char*);
+
+rhstep* SegmentRH(vector*, double, int*);
+int kFRunSteps(kfjob*, double);
+
+kffollow* CreatekFFollow(char*, double, double, double, double);
+void DestroykFFollow(kffollow*);
+int kFFollowUpdate(kffollow*, csvwriter*);
+int kFFollow(char*, char*, double, double, double, double, int);
+
+uint64_t FNV1a(uint64_t, const void*, size_t);
+uint64_t FNV1aDouble(uint64_t, double);
+uint64_t FNV1aVector(uint64_t, vector*);
+uint64_t kFCacheKeykF(vector*, vector*, double);
+csvtable* kFCacheLoad(char*, char*, uint64_t, int);
+void kFCacheSave(char*, char*, uint64_t, double*, int);
+double kFCachedXeIt(char*, int, vector*, vector*, vector*, double);
+vector* kFCachedCalckf(char*, vector*, vector*, double);
+void PrintkFCacheStats(char*);
+
 #endif
 
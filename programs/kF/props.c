@@ -0,0 +1,87 @@
+/**
+ * @file props.c
+ * Cached material properties for the kF calculations. Every run (and every
+ * job in a batch) is at a single drying temperature, so the diffusivity is
+ * tabulated as a function of moisture content once per temperature and shared
+ * from then on. Each run looks its table up once when it starts (see
+ * DiffCh10Table) and uses it directly with PropTableVal after that.
+ */
+
+#include "kf.h"
+#include "proptable.h"
+#include "material-data.h"
+
+#define PROPXMIN 1e-2 /* Smallest moisture content to tabulate [kg/kg db] */
+#define PROPXMAX 1 /* Largest moisture content to tabulate [kg/kg db] */
+#define PROPTOL 1e-6 /* Relative accuracy of the tables */
+#define PROPNTABLES 16 /* Number of temperatures to keep tables for */
+
+static double PropT[PROPNTABLES]; /* Temperature for each table [K] */
+static proptable *PropD[PROPNTABLES]; /* Diffusivity tables */
+static int PropNT = 0; /* Number of tables made so far */
+
+/**
+ * DiffCh10 as a function of moisture content only, for use with
+ * CreatePropTable.
+ * @param X Moisture content [kg/kg db]
+ * @param T Pointer to the temperature [K]
+ * @returns Diffusivity [m^2/s]
+ */
+static double DiffCh10X(double X, void *T)
+{
+    return DiffCh10(X, *((double*) T));
+}
+
+/**
+ * Get the diffusivity table for a temperature, making it the first time it is
+ * needed. Tables are kept until the program exits. A table is never changed
+ * once it has been counted in PropNT, so only making a new one needs the lock.
+ * @param T Temperature [K]
+ * @returns Diffusivity table, or NULL if PROPNTABLES temperatures have
+ *      already been used.
+ */
+proptable* DiffCh10Table(double T)
+{
+    proptable *p = NULL;
+    int i, n;
+
+#pragma omp atomic read
+    n = PropNT;
+#pragma omp flush
+    for(i=0; i<n; i++)
+        if(PropT[i] == T)
+            return PropD[i];
+
+#pragma omp critical(proptable)
+    {
+        for(i=0; i<PropNT; i++)
+            if(PropT[i] == T)
+                p = PropD[i];
+
+        if(!p && PropNT < PROPNTABLES) {
+            PropT[PropNT] = T;
+            p = CreatePropTable(&DiffCh10X, &PropT[PropNT],
+                                PROPXMIN, PROPXMAX, PROPTOL);
+            PropD[PropNT] = p;
+            n = PropNT + 1;
+#pragma omp flush
+#pragma omp atomic write
+            PropNT = n;
+        }
+    }
+
+    return p;
+}
+
+/**
+ * Diffusivity from a table made by DiffCh10Table.
+ * @param p Diffusivity table, or NULL if there wasn't one for T
+ * @param X Moisture content [kg/kg db]
+ * @param T Temperature [K]
+ * @returns Diffusivity [m^2/s]
+ */
+double DiffCh10Tab(proptable *p, double X, double T)
+{
+    return p ? PropTableVal(p, X) : DiffCh10(X, T);
+}
+
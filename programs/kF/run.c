@@ -0,0 +1,191 @@
+/**
+ * @file run.c
+ * Run the full kF analysis on a single IGASorp data file.
+ */
+
+#include "kf.h"
+#include "matrix.h"
+#include "material-data.h"
+#include "sample.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Create a filename by adding a prefix to the name of an existing file. The new
+ * file is in the same directory as the existing one.
+ * @param prefix String to put in front of the file name
+ * @param file Name of the existing file
+ * @returns Newly allocated filename
+ */
+char* PrefixFileName(char *prefix, char *file)
+{
+    char *outfile, /* Output filename */
+         *base; /* Start of the file name (after any directories) */
+    size_t dirlen; /* Length of the directory part of the name */
+
+    base = strrchr(file, '/');
+    base = base ? base+1 : file;
+    dirlen = base - file;
+
+    outfile = (char*) calloc(sizeof(char), strlen(file) + strlen(prefix) + 1);
+    strncpy(outfile, file, dirlen);
+    strcat(outfile, prefix);
+    strcat(outfile, base);
+
+    return outfile;
+}
+
+/**
+ * Create the filename for the output csv file. It is always kF prepended to
+ * the name of the input file, in the same directory as the input file.
+ * @param file Name of the input file
+ * @returns Newly allocated output filename
+ */
+char* kFOutputName(char *file)
+{
+    return PrefixFileName("kF", file);
+}
+
+/**
+ * Thin out the data so that it has just enough rows to reproduce the moisture
+ * content curve to within a tolerance (see DecimateCurve). IGASorp files are
+ * recorded at a fixed rate and spend most of their time on plateaus, so most
+ * rows can usually be dropped. The initial point is always kept.
+ * @param tol Largest allowed error in moisture content [kg/kg db]
+ * @param p0 Initial data point
+ * @param t Time vector [s]. Replaced with the decimated vector, and the
+ *      original is left alone.
+ * @param X Moisture content [kg/kg db]. Also replaced.
+ * @param w Set to the number of original rows each row stands for, for
+ *      weighting fits to the decimated data
+ * @returns Initial data point in the decimated data
+ */
+int kFDecimate(double tol, int p0, vector **t, vector **X, vector **w)
+{
+    char *keep; /* Rows to keep */
+    int n, /* Number of rows kept */
+        p0d = 0, /* Initial point in the decimated data */
+        i;
+
+    keep = (char*) calloc(sizeof(char), len(*t));
+    if(p0 >= 0 && p0 < len(*t))
+        keep[p0] = 1;
+    n = DecimateCurve(*t, *X, tol, keep);
+    for(i=0; i<p0 && i<len(*t); i++)
+        p0d += keep[i];
+
+    *w = DecimateWeights(keep, len(*t), n);
+    *t = DecimateVector(*t, keep, n);
+    *X = DecimateVector(*X, keep, n);
+    free(keep);
+
+    return p0d;
+}
+
+/**
+ * Run the kF analysis for one data file and save the results to kF<file>.
+ * Finding the initial point and the equilibrium moisture content both need
+ * the whole file, so it is loaded first. Everything after that is done by
+ * kFWriteColumns, one block of rows at a time and in parallel.
+ * @param job Data file and sample parameters
+ * @param s Summary of the results. May be NULL.
+ * @returns 0 on success
+ */
+int kFRun(kfjob *job, kfsummary *s)
+{
+    vector *t, /* Time vector [s] */
+           *X, /* Moisture content [kg/kg db] */
+           *RH, /* Relative humidity [%] */
+           *tfull = NULL, *Xfull = NULL, /* Data before decimating it */
+           *w = NULL, /* Weight of each row after decimating */
+           *kFw = NULL; /* kF fit over a sliding window [-] */
+    int p0, /* Initial data point */
+        *cols, /* Columns to save */
+        ncols, /* Number of columns */
+        i, status;
+    double Xe; /* Equilibrium moisture content [kg/kg db]*/
+    char *outfile; /* Filename to output data to */
+    FILE *fp;
+
+    /* Make sure the file is actually there before trying to load it */
+    fp = fopen(job->file, "r");
+    if(!fp) {
+        fprintf(stderr, "Unable to open %s\n", job->file);
+        return 1;
+    }
+    fclose(fp);
+
+    cols = ParsekFColumns(job->columns, &ncols);
+    if(!cols)
+        return 1;
+    /* Add the windowed kF values to the default output */
+    if(!job->columns && job->window > 0)
+        cols[ncols++] = KFCOL_KFW;
+
+    outfile = kFOutputName(job->file);
+
+    /* Every diffusivity in this run is at the same temperature */
+    job->Dtab = DiffCh10Table(job->T);
+
+    /* Load all the important information from the IGASorp file */
+    if(LoadIGASorp(job->file, job->Mdry, &t, &X, &RH)) {
+        free(cols);
+        free(outfile);
+        return 1;
+    }
+
+    /* Determine the first point to use for equilibrium moisture
+     * content and similar calculations. Values will be calculated
+     * for rows before this, but they should be disregarded.
+     */
+    p0 = FindInitialPointRH(RH);
+    printf("Starting calculations from row %d.\n", p0);
+
+    /* Drop the rows that don't add anything to the moisture content curve */
+    if(job->dectol > 0) {
+        tfull = t;
+        Xfull = X;
+        p0 = kFDecimate(job->dectol, p0, &t, &X, &w);
+        printf("Decimated %d rows to %d.\n", len(tfull), len(t));
+    }
+
+    /* If equilibrium moisture content is supplied, use that value.
+     * Otherwise, calculate Xe iteratively. In either case, print out the
+     * value. */
+    if(job->Xe >= 0)
+        Xe = job->Xe;
+    else
+        Xe = kFCachedXeIt(job->cache, p0, t, X, w, valV(X, len(X)-1)*.95);
+    printf("Xe = %g\n", Xe);
+
+    /* Smoothed kF from fitting a window of points at a time. This can't be
+     * done one row at a time, so do it first if it's needed. */
+    for(i=0; i<ncols; i++)
+        if(cols[i] == KFCOL_KFW && job->window > 0 && !kFw)
+            kFw = slidekf(t, X, Xe, job->window, job->stride);
+
+    /* Calculate the rest of the columns and write them to a csv file,
+     * expanding them back out to every original row if that was asked for. */
+    status = kFWriteColumns(job, t, X, w, job->expand ? tfull : NULL,
+                            job->expand ? Xfull : NULL, kFw, p0, Xe, cols,
+                            ncols, outfile, s);
+
+    /* Clean up */
+    DestroyVector(t);
+    DestroyVector(X);
+    DestroyVector(RH);
+    if(tfull) {
+        DestroyVector(tfull);
+        DestroyVector(Xfull);
+        DestroyVector(w);
+    }
+    if(kFw)
+        DestroyVector(kFw);
+    free(cols);
+    free(outfile);
+
+    return status;
+}
+
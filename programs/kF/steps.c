@@ -0,0 +1,259 @@
+/**
+ * @file steps.c
+ * Split a run with several relative humidity steps into separate constant
+ * humidity segments and analyze each one on its own.
+ */
+
+#include "kf.h"
+#include "matrix.h"
+#include "csv.h"
+#include "material-data.h"
+#include "sample.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define STEPMINLEN 10 /* Fewest rows a step can have */
+
+/**
+ * Split the relative humidity data into steps of constant humidity. This is
+ * done in one pass: each row is compared to the average humidity of the
+ * current step, and a new step is started whenever the difference is larger
+ * than the tolerance. Steps with fewer than STEPMINLEN rows (such as the ramp
+ * between two humidity levels) are thrown out.
+ * @param RH Vector of relative humidity values [%]
+ * @param tol How close to the step average each row needs to be [%]
+ * @param nsteps Set to the number of steps found
+ * @returns Array of steps
+ *
+ * @see FindInitialPointRH
+ */
+rhstep* SegmentRH(vector *RH, double tol, int *nsteps)
+{
+    rhstep *steps = NULL;
+    int i, /* Loop index */
+        n = 0, /* Number of steps found */
+        size = 0, /* Number of steps there is room for */
+        start = 0; /* First row of the current step */
+    double sum = 0; /* Sum of RH values in the current step */
+
+    for(i=0; i<=len(RH); i++) {
+        /* Keep going as long as the humidity matches the current step */
+        if(i < len(RH) && (i == start || fabs(valV(RH, i) - sum/(i-start)) <= tol)) {
+            sum += valV(RH, i);
+            continue;
+        }
+
+        /* Save the step if it's long enough */
+        if(i - start >= STEPMINLEN) {
+            if(n == size) {
+                size = size ? 2*size : 8;
+                steps = (rhstep*) realloc(steps, sizeof(rhstep)*size);
+            }
+            steps[n].start = start;
+            steps[n].end = i;
+            steps[n].RH = sum/(i-start);
+            n++;
+        }
+
+        /* Start a new step at this row */
+        start = i;
+        sum = (i < len(RH)) ? valV(RH, i) : 0;
+    }
+
+    *nsteps = n;
+    return steps;
+}
+
+/**
+ * Copy part of a vector into a new one.
+ * @param v Vector to copy from
+ * @param start First element to copy
+ * @param end One past the last element to copy
+ * @param offset Value to subtract from each element
+ * @param scale Value to multiply each element by (after subtracting the offset)
+ * @returns New vector
+ */
+static vector* SubVector(vector *v, int start, int end, double offset,
+                         double scale)
+{
+    vector *sub;
+    int i;
+
+    sub = CreateVector(end-start);
+    for(i=start; i<end; i++)
+        setvalV(sub, i-start, scale*(valV(v, i) - offset));
+
+    return sub;
+}
+
+/**
+ * Run the kF analysis separately on each humidity step in the data file. The
+ * steps are analyzed in parallel. Each step gets its own initial point,
+ * equilibrium moisture content, and kF values, with time measured from the
+ * start of the step. Steps where the sample picks up water are handled by
+ * flipping the sign of the moisture content, since the Crank equation only
+ * depends on \f$(X-X_e)/(X_0-X_e)\f$. Shrinkage and diffusivity only depend on
+ * moisture content, so those are calculated once for the whole run.
+ *
+ * The results for every step are saved to kF<file>, one block of rows per
+ * step, and the equilibrium moisture content for each step is saved to
+ * Xe<file>, ready for fitting an isotherm.
+ * @param job Data file and sample parameters
+ * @param tol How close to the step average the humidity needs to be [%]
+ * @returns 0 on success
+ */
+int kFRunSteps(kfjob *job, double tol)
+{
+    vector *t, /* Time vector [s] */
+           *X, /* Moisture content [kg/kg db] */
+           *RH, /* Relative humidity [%] */
+           *Lwat, /* Thickness (from density change) [m] */
+           *Diff, /* Diffusivity [m/s^2] */
+           **kF, /* kF values for each step [1/s] */
+           *ti, *Xi, *RHi, /* Data for one step */
+           *td, *Xd, *kFd, /* Decimated data for one step */
+           *wd; /* Weight of each decimated row */
+    matrix *data, /* Results for every step */
+           *eq; /* Equilibrium data for every step */
+    rhstep *steps; /* List of humidity steps */
+    int nsteps, /* Number of steps */
+        nrows = 0, /* Total number of rows in all the steps */
+        row, /* Current row of the output */
+        i, j; /* Loop indices */
+    double *Xe, /* Equilibrium moisture content for each step */
+           sgn, /* -1 for steps where the sample is gaining water */
+           kFsum;
+    int *p0, /* Initial point for each step */
+        p0d, /* Initial point in the decimated data for one step */
+        n;
+    char *outfile, *eqfile;
+    FILE *fp;
+
+    /* Make sure the file is actually there before trying to load it */
+    fp = fopen(job->file, "r");
+    if(!fp) {
+        fprintf(stderr, "Unable to open %s\n", job->file);
+        return 1;
+    }
+    fclose(fp);
+
+    if(LoadIGASorp(job->file, job->Mdry, &t, &X, &RH))
+        return 1;
+
+    steps = SegmentRH(RH, tol, &nsteps);
+    printf("Found %d humidity steps.\n", nsteps);
+    if(nsteps == 0) {
+        DestroyVector(t);
+        DestroyVector(X);
+        DestroyVector(RH);
+        return 1;
+    }
+
+    /* These only depend on moisture content */
+    Lwat = LengthDensityChange(0, X, job->L0, job->Mdry*1e-6, job->T);
+    Diff = DOswinVector(0, X, job->T);
+
+    kF = (vector**) calloc(sizeof(vector*), nsteps);
+    Xe = (double*) calloc(sizeof(double), nsteps);
+    p0 = (int*) calloc(sizeof(int), nsteps);
+
+#pragma omp parallel for schedule(dynamic) private(ti, Xi, RHi, td, Xd, kFd, wd, p0d, sgn)
+    for(i=0; i<nsteps; i++) {
+        sgn = (valV(X, steps[i].end-1) > valV(X, steps[i].start)) ? -1 : 1;
+        ti = SubVector(t, steps[i].start, steps[i].end, valV(t, steps[i].start), 1);
+        Xi = SubVector(X, steps[i].start, steps[i].end, 0, sgn);
+        RHi = SubVector(RH, steps[i].start, steps[i].end, 0, 1);
+
+        p0[i] = FindInitialPointRH(RHi);
+
+        /* With decimation, the fit and kF are calculated from the rows that
+         * are kept, and kF is interpolated back out to the rest. */
+        td = ti;
+        Xd = Xi;
+        wd = NULL;
+        p0d = p0[i];
+        if(job->dectol > 0)
+            p0d = kFDecimate(job->dectol, p0[i], &td, &Xd, &wd);
+
+        if(job->Xe >= 0)
+            Xe[i] = sgn*job->Xe;
+        else
+            Xe[i] = kFCachedXeIt(job->cache, p0d, td, Xd, wd, valV(Xd, len(Xd)-1) - .05*fabs(valV(Xd, len(Xd)-1)));
+        kF[i] = kFCachedCalckf(job->cache, td, Xd, Xe[i]);
+        Xe[i] *= sgn;
+
+        if(td != ti) {
+            kFd = kF[i];
+            kF[i] = ExpandVector(td, kFd, ti);
+            DestroyVector(kFd);
+            DestroyVector(td);
+            DestroyVector(Xd);
+            DestroyVector(wd);
+        }
+
+        DestroyVector(ti);
+        DestroyVector(Xi);
+        DestroyVector(RHi);
+    }
+
+    /* Put the results from all the steps together */
+    for(i=0; i<nsteps; i++)
+        nrows += steps[i].end - steps[i].start;
+    data = CreateMatrix(nrows, 6);
+    eq = CreateMatrix(nsteps, 7);
+    row = 0;
+    for(i=0; i<nsteps; i++) {
+        kFsum = 0;
+        n = 0;
+        for(j=steps[i].start; j<steps[i].end; j++) {
+            setval(data, i, row, 0);
+            setval(data, valV(t, j), row, 1);
+            setval(data, valV(X, j), row, 2);
+            setval(data, valV(kF[i], j-steps[i].start), row, 3);
+            setval(data, valV(Lwat, j), row, 4);
+            setval(data, valV(Diff, j), row, 5);
+            row++;
+
+            if(j-steps[i].start >= p0[i] && isfinite(valV(kF[i], j-steps[i].start))) {
+                kFsum += valV(kF[i], j-steps[i].start);
+                n++;
+            }
+        }
+
+        setval(eq, i, i, 0);
+        setval(eq, steps[i].start, i, 1);
+        setval(eq, steps[i].end, i, 2);
+        setval(eq, steps[i].RH, i, 3);
+        setval(eq, steps[i].RH/100, i, 4);
+        setval(eq, Xe[i], i, 5);
+        setval(eq, n ? kFsum/n : NAN, i, 6);
+
+        printf("Step %d: rows %d-%d, RH = %g, Xe = %g\n",
+               i, steps[i].start, steps[i].end-1, steps[i].RH, Xe[i]);
+    }
+
+    outfile = PrefixFileName("kF", job->file);
+    eqfile = PrefixFileName("Xe", job->file);
+    csvprntfilehdr(data, outfile, "Step,Time [s],Moisture Content [kg/kg db],kF,Thickness [m],D [m^2/s]\n", 0);
+    csvprntfilehdr(eq, eqfile, "Step,Start Row,End Row,RH [%],aw [-],Xe [kg/kg db],Mean kF [1/s]\n", 0);
+
+    /* Clean up */
+    for(i=0; i<nsteps; i++)
+        DestroyVector(kF[i]);
+    free(kF);
+    free(Xe);
+    free(p0);
+    free(steps);
+    free(outfile);
+    free(eqfile);
+    DestroyMatrix(data);
+    DestroyMatrix(eq);
+    DestroyVector(t);
+    DestroyVector(X);
+    DestroyVector(RH);
+    DestroyVector(Lwat);
+    DestroyVector(Diff);
+
+    return 0;
+}
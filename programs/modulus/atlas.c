@@ -0,0 +1,322 @@
+/**
+ * @file atlas.c
+ * Precalculate the storage and loss moduli over a grid of temperature,
+ * moisture content, and frequency, and save them to a binary file so that they
+ * can be looked up later without recalculating anything.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stress-strain.h"
+#include "atlas.h"
+
+#define ATLASMAGIC "MODATLAS" /* First bytes of every atlas file */
+#define ATLASVERSION 1 /* Increment whenever the file layout changes */
+
+/**
+ * Allocate an atlas with all of the moduli set to zero.
+ * @param Tmin Lowest temperature [K]
+ * @param Tmax Highest temperature [K]
+ * @param nT Number of temperatures
+ * @param Xmin Lowest moisture content [kg/kg db]
+ * @param Xmax Highest moisture content [kg/kg db]
+ * @param nX Number of moisture contents
+ * @param wmin Lowest frequency [rad/s]
+ * @param wmax Highest frequency [rad/s]
+ * @param nw Number of frequencies
+ * @returns New atlas
+ */
+atlas* CreateAtlas(double Tmin, double Tmax, int nT,
+                   double Xmin, double Xmax, int nX,
+                   double wmin, double wmax, int nw)
+{
+    atlas *a;
+
+    a = (atlas*) calloc(sizeof(atlas), 1);
+    a->Tmin = Tmin;
+    a->Tmax = Tmax;
+    a->nT = nT;
+    a->Xmin = Xmin;
+    a->Xmax = Xmax;
+    a->nX = nX;
+    a->wmin = wmin;
+    a->wmax = wmax;
+    a->nw = nw;
+    a->E1 = (double*) calloc(sizeof(double), nT*nX*nw);
+    a->E2 = (double*) calloc(sizeof(double), nT*nX*nw);
+
+    return a;
+}
+
+/**
+ * Free an atlas.
+ * @param a Atlas to destroy
+ */
+void DestroyAtlas(atlas *a)
+{
+    free(a->E1);
+    free(a->E2);
+    free(a);
+}
+
+/**
+ * Value of the ith point out of n evenly spaced between min and max.
+ */
+static double gridpt(double min, double max, int i, int n)
+{
+    return (n > 1) ? min + (max-min)*i/(n-1) : min;
+}
+
+/**
+ * Calculate the moduli at every point in the grid using Rozzi's relaxation
+ * function (see dynamic_modulus_rozzi). Each temperature/moisture content pair
+ * is independent, so they are split up between threads.
+ * @param Tmin Lowest temperature [K]
+ * @param Tmax Highest temperature [K]
+ * @param nT Number of temperatures
+ * @param Xmin Lowest moisture content [kg/kg db]
+ * @param Xmax Highest moisture content [kg/kg db]
+ * @param nX Number of moisture contents
+ * @param wmin Lowest frequency [rad/s]
+ * @param wmax Highest frequency [rad/s]
+ * @param nw Number of frequencies
+ * @returns New atlas
+ */
+atlas* BuildAtlas(double Tmin, double Tmax, int nT,
+                  double Xmin, double Xmax, int nX,
+                  double wmin, double wmax, int nw)
+{
+    atlas *a;
+    double *w; /* Frequencies */
+    int i, k;
+
+    a = CreateAtlas(Tmin, Tmax, nT, Xmin, Xmax, nX, wmin, wmax, nw);
+
+    w = (double*) calloc(sizeof(double), nw);
+    for(k=0; k<nw; k++)
+        w[k] = exp(gridpt(log(wmin), log(wmax), k, nw));
+
+#pragma omp parallel for schedule(dynamic)
+    for(i=0; i<nT*nX; i++)
+        dynamic_modulus_rozzi(gridpt(Tmin, Tmax, i/nX, nT),
+                              gridpt(Xmin, Xmax, i%nX, nX),
+                              w, nw, a->E1 + i*nw, a->E2 + i*nw, NULL);
+
+    free(w);
+
+    return a;
+}
+
+/**
+ * Save an atlas to a binary file. The file has a short header with the size
+ * and range of the grid, followed by the storage and loss moduli.
+ * @param a Atlas to save
+ * @param file Name of the file to save to
+ * @returns 0 on success
+ */
+int SaveAtlas(atlas *a, char *file)
+{
+    FILE *fp;
+    int version = ATLASVERSION,
+        dims[3] = {a->nT, a->nX, a->nw},
+        n = a->nT*a->nX*a->nw,
+        ok;
+    double range[6] = {a->Tmin, a->Tmax, a->Xmin, a->Xmax, a->wmin, a->wmax};
+
+    fp = fopen(file, "wb");
+    if(!fp)
+        return 1;
+
+    ok = fwrite(ATLASMAGIC, 1, strlen(ATLASMAGIC), fp) == strlen(ATLASMAGIC)
+        && fwrite(&version, sizeof(int), 1, fp) == 1
+        && fwrite(dims, sizeof(int), 3, fp) == 3
+        && fwrite(range, sizeof(double), 6, fp) == 6
+        && fwrite(a->E1, sizeof(double), n, fp) == n
+        && fwrite(a->E2, sizeof(double), n, fp) == n;
+    fclose(fp);
+
+    return !ok;
+}
+
+/**
+ * Check that the grid dimensions read from an atlas file are usable and that
+ * the rest of the file holds exactly the moduli for that grid.
+ * @param dims Number of temperatures, moisture contents, and frequencies
+ * @param left Number of bytes in the file after the header
+ * @returns Number of grid points, or 0 if the file is bad
+ */
+static int atlasdims(int dims[3], long left)
+{
+    int n = 1, /* Number of grid points */
+        i;
+
+    /* Each axis needs two points for gridpos to interpolate between */
+    for(i=0; i<3; i++) {
+        if(dims[i] < 2 || dims[i] > INT_MAX/n)
+            return 0;
+        n *= dims[i];
+    }
+
+    /* Two moduli per grid point */
+    if(left < 0 || left % (2*sizeof(double)) != 0
+            || left / (2*sizeof(double)) != n)
+        return 0;
+
+    return n;
+}
+
+/**
+ * Load an atlas saved with SaveAtlas.
+ * @param file Name of the file to load
+ * @returns Atlas, or NULL if the file can't be read or isn't an atlas.
+ */
+atlas* LoadAtlas(char *file)
+{
+    FILE *fp;
+    atlas *a = NULL;
+    char magic[sizeof(ATLASMAGIC)] = {0};
+    int version, dims[3], n = 0;
+    long start, end; /* Offsets of the moduli and the end of the file */
+    double range[6];
+
+    fp = fopen(file, "rb");
+    if(!fp)
+        return NULL;
+
+    if(fread(magic, 1, strlen(ATLASMAGIC), fp) == strlen(ATLASMAGIC)
+            && strcmp(magic, ATLASMAGIC) == 0
+            && fread(&version, sizeof(int), 1, fp) == 1
+            && version == ATLASVERSION
+            && fread(dims, sizeof(int), 3, fp) == 3
+            && fread(range, sizeof(double), 6, fp) == 6
+            && (start = ftell(fp)) >= 0
+            && fseek(fp, 0, SEEK_END) == 0
+            && (end = ftell(fp)) >= 0
+            && fseek(fp, start, SEEK_SET) == 0)
+        n = atlasdims(dims, end - start);
+
+    if(n > 0) {
+        a = CreateAtlas(range[0], range[1], dims[0], range[2], range[3],
+                        dims[1], range[4], range[5], dims[2]);
+        if(fread(a->E1, sizeof(double), n, fp) != n
+                || fread(a->E2, sizeof(double), n, fp) != n) {
+            DestroyAtlas(a);
+            a = NULL;
+        }
+    }
+    fclose(fp);
+
+    return a;
+}
+
+/**
+ * Load an atlas from a file if it covers the requested grid, otherwise build
+ * it and save it to the file for next time.
+ * @param file Name of the cache file
+ * @param Tmin Lowest temperature [K]
+ * @param Tmax Highest temperature [K]
+ * @param nT Number of temperatures
+ * @param Xmin Lowest moisture content [kg/kg db]
+ * @param Xmax Highest moisture content [kg/kg db]
+ * @param nX Number of moisture contents
+ * @param wmin Lowest frequency [rad/s]
+ * @param wmax Highest frequency [rad/s]
+ * @param nw Number of frequencies
+ * @returns Atlas
+ */
+atlas* AtlasCache(char *file, double Tmin, double Tmax, int nT,
+                  double Xmin, double Xmax, int nX,
+                  double wmin, double wmax, int nw)
+{
+    atlas *a;
+
+    a = LoadAtlas(file);
+    if(a && a->nT == nT && a->Tmin == Tmin && a->Tmax == Tmax
+            && a->nX == nX && a->Xmin == Xmin && a->Xmax == Xmax
+            && a->nw == nw && a->wmin == wmin && a->wmax == wmax)
+        return a;
+    if(a)
+        DestroyAtlas(a);
+
+    a = BuildAtlas(Tmin, Tmax, nT, Xmin, Xmax, nX, wmin, wmax, nw);
+    if(SaveAtlas(a, file))
+        fprintf(stderr, "Unable to save %s\n", file);
+
+    return a;
+}
+
+/**
+ * Find the position of a value in an evenly spaced grid. The value is clamped
+ * to the ends of the grid.
+ * @param x Value to look up
+ * @param min First grid point
+ * @param max Last grid point
+ * @param n Number of grid points
+ * @param f Set to the fractional distance to the next grid point
+ * @returns Index of the grid point at or below x
+ */
+static int gridpos(double x, double min, double max, int n, double *f)
+{
+    double p;
+    int i;
+
+    if(n < 2 || max == min) {
+        *f = 0;
+        return 0;
+    }
+
+    p = (n-1)*(x-min)/(max-min);
+    if(p < 0)
+        p = 0;
+    if(p > n-1)
+        p = n-1;
+    i = (int) p;
+    if(i > n-2)
+        i = n-2;
+    *f = p - i;
+
+    return i;
+}
+
+/**
+ * Look up the storage and loss moduli at a point by trilinear interpolation
+ * in temperature, moisture content, and log frequency. Points outside the
+ * grid get the value at the nearest edge.
+ * @param a Atlas
+ * @param T Temperature [K]
+ * @param X Moisture content [kg/kg db]
+ * @param w Angular frequency [rad/s]
+ * @param E1 Set to the storage modulus. May be NULL.
+ * @param E2 Set to the loss modulus. May be NULL.
+ */
+void AtlasQuery(atlas *a, double T, double X, double w,
+                double *E1, double *E2)
+{
+    double fT, fX, fw, wt, s1 = 0, s2 = 0;
+    int iT, iX, iw, dT, dX, dw, idx;
+
+    iT = gridpos(T, a->Tmin, a->Tmax, a->nT, &fT);
+    iX = gridpos(X, a->Xmin, a->Xmax, a->nX, &fX);
+    iw = gridpos(log(w), log(a->wmin), log(a->wmax), a->nw, &fw);
+
+    /* Add up the contribution from each corner of the cell */
+    for(dT=0; dT<2 && iT+dT<a->nT; dT++) {
+        for(dX=0; dX<2 && iX+dX<a->nX; dX++) {
+            for(dw=0; dw<2 && iw+dw<a->nw; dw++) {
+                wt = (dT ? fT : 1-fT) * (dX ? fX : 1-fX) * (dw ? fw : 1-fw);
+                idx = ((iT+dT)*a->nX + iX+dX)*a->nw + iw+dw;
+                s1 += wt*a->E1[idx];
+                s2 += wt*a->E2[idx];
+            }
+        }
+    }
+
+    if(E1)
+        *E1 = s1;
+    if(E2)
+        *E2 = s2;
+}
+
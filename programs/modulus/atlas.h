@@ -0,0 +1,30 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+/**
+ * Table of storage and loss moduli over a grid of temperature, moisture
+ * content, and frequency. Temperature and moisture content are evenly spaced,
+ * and frequency is spaced logarithmically.
+ */
+typedef struct {
+    int nT, nX, nw; /* Number of points in each direction */
+    double Tmin, Tmax, /* Temperature range [K] */
+           Xmin, Xmax, /* Moisture content range [kg/kg db] */
+           wmin, wmax, /* Frequency range [rad/s] */
+           *E1, /* Storage modulus, indexed by [T][X][w] */
+           *E2; /* Loss modulus */
+} atlas;
+
+atlas* CreateAtlas(double, double, int, double, double, int,
+                   double, double, int);
+void DestroyAtlas(atlas*);
+atlas* BuildAtlas(double, double, int, double, double, int,
+                  double, double, int);
+int SaveAtlas(atlas*, char*);
+atlas* LoadAtlas(char*);
+atlas* AtlasCache(char*, double, double, int, double, double, int,
+                  double, double, int);
+void AtlasQuery(atlas*, double, double, double, double*, double*);
+
+#endif
+
@@ -0,0 +1,61 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "atlas.h"
+
+int main(int argc, char *argv[])
+{
+    atlas *a; /* Table of moduli */
+    double E1, E2; /* Storage and loss moduli */
+    int query = 0, /* Look up a value instead of building the atlas */
+        c;
+
+    while((c = getopt(argc, argv, "q")) != -1) {
+        switch(c) {
+            case 'q':
+                query = 1;
+                break;
+            default:
+                exit(1);
+        }
+    }
+    argc -= optind-1;
+    argv += optind-1;
+
+    /* Print a usage statement if not enough arguments are supplied */
+    if((query && argc != 5) || (!query && argc != 11)) {
+        puts("Usage:");
+        puts("modulus-atlas <atlas.bin> <Tmin> <Tmax> <nT> <Xmin> <Xmax> <nX> <wmin> <wmax> <nw>");
+        puts("modulus-atlas -q <atlas.bin> <T> <Xdb> <w>");
+        puts("Calculate the storage and loss moduli over a grid of temperature [K],");
+        puts("moisture content [kg/kg db], and frequency [rad/s] and save them to");
+        puts("atlas.bin. Frequencies are spaced logarithmically. If atlas.bin already");
+        puts("has the same grid, it is reused.");
+        puts("-q: Look up the moduli at one point in an existing atlas.");
+
+        exit(0);
+    }
+
+    if(query) {
+        a = LoadAtlas(argv[1]);
+        if(!a) {
+            fprintf(stderr, "Unable to load %s\n", argv[1]);
+            exit(1);
+        }
+        AtlasQuery(a, atof(argv[2]), atof(argv[3]), atof(argv[4]), &E1, &E2);
+        printf("Storage Modulus: %g\nLoss Modulus: %g\n", E1, E2);
+    } else {
+        a = AtlasCache(argv[1],
+                       atof(argv[2]), atof(argv[3]), atoi(argv[4]),
+                       atof(argv[5]), atof(argv[6]), atoi(argv[7]),
+                       atof(argv[8]), atof(argv[9]), atoi(argv[10]));
+        printf("Saved %d x %d x %d grid to %s\n",
+               a->nT, a->nX, a->nw, argv[1]);
+    }
+
+    DestroyAtlas(a);
+
+    return 0;
+}
+
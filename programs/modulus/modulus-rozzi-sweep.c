@@ -1,7 +1,9 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "matrix.h"
+#include "csv.h"
 #include "material-data.h"
 #include "stress-strain.h"
 
@@ -16,20 +18,46 @@ int main(int argc, char *argv[])
            Xdb; /* Moisture content [kg/kg db] */
     maxwell *m; /* Set of Maxwell material parameters */
     matrix *beta; /* Coefficient matrix for regression */
-    vector *frequency, *storage, *loss;
+    vector *frequency, *storage, *loss, *tand;
     matrix *output;
-    int npts = 100, i;
+    int npts = 100, i,
+        validate = 0, /* Simulate and fit instead of using the closed form */
+        logspace = 0, /* Space the frequencies logarithmically */
+        c;
+    double *w; /* Frequency, storage, loss, and loss tangent for the sweep */
     char *outfile;
 
+    while((c = getopt(argc, argv, "vln:")) != -1) {
+        switch(c) {
+            case 'v':
+                validate = 1;
+                break;
+            case 'l':
+                logspace = 1;
+                break;
+            case 'n':
+                npts = atoi(optarg);
+                break;
+            default:
+                exit(1);
+        }
+    }
+    argc -= optind-1;
+    argv += optind-1;
+
     /* Print a usage statement if not enough arguments are supplied */
-    if(argc != 6) {
+    if(argc != 6 || npts < 2) {
         puts("Usage:");
-        puts("modulus <e0> <w> <T> <Xdb>");
+        puts("modulus-sweep [-v] [-l] [-n <npts>] <e0> <wmin> <wmax> <T> <Xdb>");
         puts("e0: Imposed strain magnitude");
-        puts("w: Minimum frequency of strain oscillation");
-        puts("w: Maximum frequency of strain oscillation");
+        puts("wmin: Minimum frequency of strain oscillation");
+        puts("wmax: Maximum frequency of strain oscillation");
         puts("T: Material temperature [K]");
         puts("Xdb: Material moisture content [kg/kg db]");
+        puts("-v: Simulate the stress response and fit a sine wave to it at");
+        puts("    each frequency instead of calculating the moduli directly.");
+        puts("-l: Space the frequencies logarithmically instead of linearly.");
+        puts("-n: Number of frequencies to calculate (default 100).");
 
         exit(0);
     }
@@ -42,26 +70,54 @@ int main(int argc, char *argv[])
     Xdb = atof(argv[5]);
 
     frequency = linspaceV(wmin, wmax, npts);
+    if(logspace)
+        for(i=0; i<npts; i++)
+            setvalV(frequency, i, wmin*pow(wmax/wmin, (double) i/(npts-1)));
     storage = CreateVector(npts);
     loss = CreateVector(npts);
+    tand = CreateVector(npts);
 
-    for(i=0; i<npts; i++) {
-        /* Fit the measured stress to the equation: s = s0 * sin(t*w+shift) */
-        beta = fit_stress_rozzi(e0, valV(frequency, i), T, Xdb);
+    if(validate) {
+        for(i=0; i<npts; i++) {
+            /* Fit the measured stress to the equation: s = s0 * sin(t*w+shift) */
+            beta = fit_stress_rozzi(e0, valV(frequency, i), T, Xdb);
 
-        /* Grab stress magnitude and phase lag from the coefficient matrix */
-        s0 = val(beta, 0, 0);
-        shift = val(beta, 1, 0);
+            /* Grab stress magnitude and phase lag from the coefficient matrix */
+            s0 = val(beta, 0, 0);
+            shift = val(beta, 1, 0);
 
-        setvalV(storage, i, storage_mod(e0, s0, shift));
-        setvalV(loss, i, loss_mod(e0, s0, shift));
+            setvalV(storage, i, storage_mod(e0, s0, shift));
+            setvalV(loss, i, loss_mod(e0, s0, shift));
+            setvalV(tand, i, tan(shift));
+            DestroyMatrix(beta);
+        }
+    } else {
+        /* Calculate the whole sweep at once from the relaxation function */
+        w = (double*) calloc(sizeof(double), 4*npts);
+        for(i=0; i<npts; i++)
+            w[i] = valV(frequency, i);
+        dynamic_modulus_rozzi(T, Xdb, w, npts, w+npts, w+2*npts, w+3*npts);
+        for(i=0; i<npts; i++) {
+            setvalV(storage, i, w[npts+i]);
+            setvalV(loss, i, w[2*npts+i]);
+            setvalV(tand, i, w[3*npts+i]);
+        }
+        free(w);
     }
 
-    outfile = (char*) calloc(sizeof(char), 20);
+    c = snprintf(NULL, 0, "output-%g-%g.csv", T, Xdb);
+    outfile = (char*) calloc(sizeof(char), c+1);
     sprintf(outfile, "output-%g-%g.csv", T, Xdb);
 
-    output = CatColVector(3, frequency, storage, loss);
-    mtxprntfilehdr(output, outfile, "freq(hz),storage,loss\n");
+    output = CatColVector(4, frequency, storage, loss, tand);
+    csvprntfilehdr(output, outfile, "freq(hz),storage,loss,tan delta\n", 0);
+
+    free(outfile);
+    DestroyMatrix(output);
+    DestroyVector(frequency);
+    DestroyVector(storage);
+    DestroyVector(loss);
+    DestroyVector(tand);
 
     return 0;
 }
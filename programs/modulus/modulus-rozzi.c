@@ -1,6 +1,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "matrix.h"
 #include "material-data.h"
 #include "stress-strain.h"
@@ -12,18 +13,35 @@ int main(int argc, char *argv[])
            w, /* Strain oscillation frequency [1/s] */
            shift, /* Phase lag between stress and strain [-] */
            T, /* Temperature of material [K] */
-           Xdb; /* Moisture content [kg/kg db] */
+           Xdb, /* Moisture content [kg/kg db] */
+           E1, E2, tand; /* Storage modulus, loss modulus, and loss tangent */
     maxwell *m; /* Set of Maxwell material parameters */
     matrix *beta; /* Coefficient matrix for regression */
+    int validate = 0, /* Also simulate the stress response and fit it */
+        c;
+
+    while((c = getopt(argc, argv, "v")) != -1) {
+        switch(c) {
+            case 'v':
+                validate = 1;
+                break;
+            default:
+                exit(1);
+        }
+    }
+    argc -= optind-1;
+    argv += optind-1;
 
     /* Print a usage statement if not enough arguments are supplied */
     if(argc != 5) {
         puts("Usage:");
-        puts("modulus <e0> <w> <T> <Xdb>");
+        puts("modulus-rozzi [-v] <e0> <w> <T> <Xdb>");
         puts("e0: Imposed strain magnitude");
         puts("w: Frequency of strain oscillation");
         puts("T: Material temperature [K]");
         puts("Xdb: Material moisture content [kg/kg db]");
+        puts("-v: Also simulate the stress response and fit a sine wave to it");
+        puts("    to check the calculated moduli.");
 
         exit(0);
     }
@@ -34,16 +52,24 @@ int main(int argc, char *argv[])
     T = atof(argv[3]);
     Xdb = atof(argv[4]);
 
-    /* Fit the measured stress to the equation: s = s0 * sin(t*w+shift) */
-    beta = fit_stress_rozzi(e0, w, T, Xdb);
+    /* Calculate the moduli directly from the relaxation function */
+    dynamic_modulus_rozzi(T, Xdb, &w, 1, &E1, &E2, &tand);
+    printf("Storage Modulus: %g\nLoss Modulus: %g\nLoss Tangent: %g\n",
+            E1, E2, tand);
 
-    /* Grab stress magnitude and phase lag from the coefficient matrix */
-    s0 = val(beta, 0, 0);
-    shift = val(beta, 1, 0);
+    if(validate) {
+        /* Fit the measured stress to the equation: s = s0 * sin(t*w+shift) */
+        beta = fit_stress_rozzi(e0, w, T, Xdb);
 
-    /* Calculate the storage and loss moduli and print them */
-    printf("Storage Modulus: %g\nLoss Modulus: %g\n",
-            storage_mod(e0, s0, shift), loss_mod(e0, s0, shift));
+        /* Grab stress magnitude and phase lag from the coefficient matrix */
+        s0 = val(beta, 0, 0);
+        shift = val(beta, 1, 0);
+
+        /* Calculate the storage and loss moduli and print them */
+        printf("Storage Modulus (fit): %g\nLoss Modulus (fit): %g\n",
+                storage_mod(e0, s0, shift), loss_mod(e0, s0, shift));
+        DestroyMatrix(beta);
+    }
 
     return 0;
 }
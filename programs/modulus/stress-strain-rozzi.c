@@ -5,13 +5,29 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
 #include "material-data.h"
 #include "matrix.h"
 #include "regress.h"
+#include "fftconv.h"
+#include "hereditary.h"
 #include "stress-strain.h"
 
-/** Frequency global variable */
-double w;
+/** Frequency global variable (defined in stress-strain.c) */
+extern double w;
+
+/**
+ * Relaxation function from Rozzi's data in the form needed by FitProny.
+ * @param t Time [s]
+ * @param params Pointer to a maxwellparams struct. The Maxwell parameters
+ *      aren't used.
+ * @returns Relaxation modulus [Pa]
+ */
+static double MaxwellRelaxLauraP(double t, void *params)
+{
+    maxwellparams *mp = (maxwellparams*) params;
+    return MaxwellRelaxLaura(t, mp->T, mp->M);
+}
 
 /**
  * Calculate the stress on a viscoelastic material using the Maxwell model
@@ -21,7 +37,11 @@ double w;
  * \sigma(t) = \int_{\tau_0}^t\! G(t-\tau)\dot{\epsilon}(\tau)\,\mathrm{d}\tau
  * \f]
  *
- * @param m Maxwell material parameters
+ * Rozzi's relaxation function can't be written as a short sum of
+ * exponentials, so the relaxation function is sampled at each time step and
+ * the integral is evaluated as a discrete convolution using the FFT (see
+ * FFTConvolve), which takes O(n log n) time.
+ *
  * @param t Column matrix of time values [s]
  * @param de Matrix containing the time derivative of strain [1/s]
  * @param T Temperature [K]
@@ -32,22 +52,35 @@ matrix* maxwell_stress_rozzi(matrix *t, matrix *de,
                        double T, double M)
 {
     matrix *s;
-    int i, j; /* Loop indicies */
+    int i, /* Loop index */
+        n = nRows(t); /* Number of time steps */
     double dt = val(t, 1, 0) - val(t, 0, 0), /* Delta t */
-           stress; /* Intermediate value used for integration */
+           *K, /* Relaxation function at each time step */
+           *x, /* Strain rate */
+           *y; /* Stress */
 
-    /* Make a matrix to store the output in */
-    s = CreateMatrix(nRows(t), 1);
+    K = (double*) calloc(sizeof(double), n);
+    x = (double*) calloc(sizeof(double), n);
+    y = (double*) calloc(sizeof(double), n);
+
+    /* Only points before the current one contribute to the integral, so the
+     * first value of the kernel is zero. */
+    for(i=1; i<n; i++)
+        K[i] = MaxwellRelaxLaura(i*dt, T, M) * dt;
+    for(i=0; i<n; i++)
+        x[i] = val(de, i, 0);
 
     /* Numerically integrate the equation for each time step */
-    for(i=0; i<nRows(t); i++) {
-        for(j=0; j<i; j++) {
-            stress = 0;
-            stress += MaxwellRelaxLaura(val(t, j, 0), T, M)
-                * val(de, j, 0) * dt;
-        }
-        setval(s, stress, i, 0);
-    }
+    FFTConvolve(K, n, x, y, n);
+
+    /* Make a matrix to store the output in */
+    s = CreateMatrix(n, 1);
+    for(i=0; i<n; i++)
+        setval(s, y[i], i, 0);
+
+    free(K);
+    free(x);
+    free(y);
 
     return s;
 }
@@ -56,26 +89,23 @@ matrix* maxwell_stress_rozzi(matrix *t, matrix *de,
  * Fit the measured stress to calculate stress magnitude and phase lag.
  * Stress-strain data is generated based on the supplied strain magnitude,
  * oscillation frequency, Maxwell parameters, temperature, and moisture content.
- * The stress magnitude and phase lag are then calculated using nonlinear
- * regression.
+ * The stress magnitude and phase lag are then found by demodulating the stress
+ * (see demod_stress).
  * @param e0 Strain magnitude [-]
  * @param freq Oscillation frequency [1/s]
  * @param m Maxwell parameters
  * @param T Temperature [K]
  * @param X Moisture content [kg/kg db]
- * @returns A 2x1 matrix. Element 1,1 is strain magnitude, and element 2,1 is
- *      phase lag.
+ * @returns A 4x1 matrix. Element 1,1 is stress magnitude, element 2,1 is
+ *      phase lag, and elements 3,1 and 4,1 are the storage and loss moduli.
  */
 matrix* fit_stress_rozzi(double e0, double freq, double T, double X)
 {
     int i, /* Loop index */
         npts = 1000; /* Number of points to use for fitting the data */
-    double dt = .1, /* Time step size to use when generating data */
-           s0guess = e0*MaxwellRelaxLaura(.01, T, X), /* Initial guess for the stress magnitude */
-           shiftguess = .3; /* Initial guess for phase lag */
+    double dt = .1; /* Time step size to use when generating data */
     matrix *t, /* Time matrix */
            *e, /* Strain */
-           *beta0, /* Initial guess for fitting coefficients */
            *beta, /* Fitting parameter matrix */
            *de, /* Time deriviative of strain */
            *s; /* Stress */
@@ -95,20 +125,49 @@ matrix* fit_stress_rozzi(double e0, double freq, double T, double X)
         setval(de, dstrain(e0, i*dt), i, 0);
     }
 
-    /* Create the initial guess matrix for the regression parameters */
-    beta0 = CreateMatrix(2, 1);
-    setval(beta0, s0guess, 0, 0);
-    setval(beta0, shiftguess, 1, 0);
-
     /* Calculate the values for stress at each point in time based on the
      * Maxwell material model */
     s = maxwell_stress_rozzi(t, de, T, X);
 
-    /* Fit the stress to the appropriate equation to find stress magnitude and
-     * phase lag */
-    beta = fitnlm(&stress_model, t, s, beta0);
+    /* Demodulate the stress to find stress magnitude and phase lag */
+    beta = demod_stress(t, s, freq, e0);
+
+    DestroyMatrix(t);
+    DestroyMatrix(e);
+    DestroyMatrix(de);
+    DestroyMatrix(s);
 
     /* Return the results */
     return beta;
 }
 
+
+/**
+ * Calculate the storage modulus, loss modulus, and loss tangent directly from
+ * Rozzi's relaxation function at a set of frequencies. See dynamic_modulus.
+ * @param T Temperature [K]
+ * @param X Moisture content [kg/kg db]
+ * @param freq Array of angular frequencies [rad/s]
+ * @param n Number of frequencies
+ * @param E1 Array to store the storage modulus in. May be NULL.
+ * @param E2 Array to store the loss modulus in. May be NULL.
+ * @param tand Array to store the loss tangent in. May be NULL.
+ */
+void dynamic_modulus_rozzi(double T, double X, double *freq, int n,
+                           double *E1, double *E2, double *tand)
+{
+    maxwellparams mp = {NULL, T, X};
+    double wmin = freq[0], wmax = freq[0];
+    prony *p;
+    int i;
+
+    for(i=1; i<n; i++) {
+        wmin = fmin(wmin, freq[i]);
+        wmax = fmax(wmax, freq[i]);
+    }
+
+    p = modulus_prony(&MaxwellRelaxLauraP, &mp, wmin, wmax);
+    PronyModulus(p, freq, n, E1, E2, tand);
+    DestroyProny(p);
+}
+
@@ -5,13 +5,34 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include "material-data.h"
 #include "matrix.h"
 #include "regress.h"
+#include "hereditary.h"
+#include "stress-strain.h"
+
+#define MODRANGE 100 /* How far outside 1/w the relaxation function is fit */
+#define DEMODTOL 1e-2 /* Relative change between cycles allowed after the transient */
+#define DEMODNSUM 9 /* Number of running sums kept for each cycle */
+#define DEMODMINPTS 3 /* Fewest points that a sine and offset can be fit to */
 
 /** Frequency global variable */
 double w;
 
+/**
+ * Relaxation function for the Maxwell model in the form needed by FitProny.
+ * @param t Time [s]
+ * @param params Pointer to a maxwellparams struct
+ * @returns Relaxation modulus [Pa]
+ */
+static double MaxwellRelaxP(double t, void *params)
+{
+    maxwellparams *mp = (maxwellparams*) params;
+    return MaxwellRelax(mp->m, t, mp->T, mp->M);
+}
+
 /**
  * Calculate the imposed strain based on the strain magnitude, oscillation
  * frequency, and current time. Frequency is supplied via a global variable.
@@ -35,22 +56,6 @@ double dstrain(double e0, double t)
     return e0*w*cos(t*w);
 }
 
-/**
- * Function used to fit the calculate stress to the function:
- * \f[ \sigma = \sigma_0 \sin(t w + \delta) \f]
- * @param t Time [s]
- * @param beta Coefficient matrix. The first one is strain magnitude, and the
- *      second is phase lag.
- * @returns Stress [-]
- */
-double stress_model(double t, matrix *beta)
-{
-    double s0 = val(beta, 0, 0),
-           shift = val(beta, 1, 0);
-
-    return s0*sin(t*w+shift);
-}
-
 /**
  * Calculate the stress on a viscoelastic material using the Maxwell model
  * relaxation function with temperature and moisture effects.
@@ -59,6 +64,10 @@ double stress_model(double t, matrix *beta)
  * \sigma(t) = \int_{\tau_0}^t\! G(t-\tau)\dot{\epsilon}(\tau)\,\mathrm{d}\tau
  * \f]
  *
+ * The relaxation function is first fit to a Prony series covering the time
+ * span of the data, and the integral is then evaluated recursively (see
+ * HereditaryStep), so this takes linear time.
+ *
  * @param m Maxwell material parameters
  * @param t Column matrix of time values [s]
  * @param de Matrix containing the time derivative of strain [1/s]
@@ -70,50 +79,246 @@ matrix* maxwell_stress(maxwell *m, matrix *t, matrix *de,
                        double T, double M)
 {
     matrix *s;
-    int i, j; /* Loop indicies */
+    int i; /* Loop index */
     double dt = val(t, 1, 0) - val(t, 0, 0), /* Delta t */
            stress; /* Intermediate value used for integration */
+    maxwellparams mp = {m, T, M};
+    prony *p; /* Relaxation function as a Prony series */
+    hereditary *h; /* State for the stress integral */
 
     /* Make a matrix to store the output in */
     s = CreateMatrix(nRows(t), 1);
 
+    p = FitProny(&MaxwellRelaxP, &mp, dt, val(t, nRows(t)-1, 0) - val(t, 0, 0));
+    h = CreateHereditary(p);
+
     /* Numerically integrate the equation for each time step */
     for(i=0; i<nRows(t); i++) {
-        for(j=0; j<i; j++) {
-            stress = 0;
-            stress += MaxwellRelax(m, val(t, j, 0), T, M)
-                * val(de, j, 0) * dt;
-        }
+        stress = HereditaryStep(h, p, dt, val(de, i, 0) * dt);
         setval(s, stress, i, 0);
     }
 
+    DestroyHereditary(h);
+    DestroyProny(p);
+
     return s;
 }
 
+/**
+ * Solve the least squares problem for
+ * \f[ \sigma = a \sin(\omega t) + b \cos(\omega t) + c \f]
+ * given the sums of the products of the basis functions and the data.
+ * @param S Array of sums: sin*sin, sin*cos, cos*cos, sin, cos, 1, y*sin,
+ *      y*cos, and y
+ * @param a Set to the sine coefficient
+ * @param b Set to the cosine coefficient
+ * @returns 0 on success, or 1 if there are too few points (or they're placed
+ *      so that a and b can't be found)
+ */
+static int demod_solve(double *S, double *a, double *b)
+{
+    double A[3][3] = {{S[0], S[1], S[3]},
+                      {S[1], S[2], S[4]},
+                      {S[3], S[4], S[5]}},
+           y[3] = {S[6], S[7], S[8]},
+           det;
+
+    /* Cramer's rule */
+    det = A[0][0]*(A[1][1]*A[2][2] - A[1][2]*A[2][1])
+        - A[0][1]*(A[1][0]*A[2][2] - A[1][2]*A[2][0])
+        + A[0][2]*(A[1][0]*A[2][1] - A[1][1]*A[2][0]);
+    if(S[5] < DEMODMINPTS || !isnormal(det))
+        return 1;
+    *a = (y[0]*(A[1][1]*A[2][2] - A[1][2]*A[2][1])
+        - A[0][1]*(y[1]*A[2][2] - A[1][2]*y[2])
+        + A[0][2]*(y[1]*A[2][1] - A[1][1]*y[2]))/det;
+    *b = (A[0][0]*(y[1]*A[2][2] - A[1][2]*y[2])
+        - y[0]*(A[1][0]*A[2][2] - A[1][2]*A[2][0])
+        + A[0][2]*(A[1][0]*y[2] - y[1]*A[2][0]))/det;
+    return 0;
+}
+
+/**
+ * Demodulate one column of stress data. See demod_stress.
+ * @param t Column matrix of time values [s]
+ * @param s Matrix of stress values
+ * @param col Column of s to use
+ * @param freq Angular frequency of the imposed strain [rad/s]
+ * @param e0 Strain magnitude [-]
+ * @param out Array to store s0, phase lag, E', and E'' in
+ */
+static void demod_column(matrix *t, matrix *s, int col, double freq,
+                         double e0, double *out)
+{
+    double *S, /* Running sums for each cycle */
+           tot[DEMODNSUM] = {0}, /* Sums over the cycles that are used */
+           period = 2*M_PI/freq,
+           t0 = val(t, 0, 0),
+           sn, cs, y, a, b, ak, bk;
+    int n = nRows(t),
+        ncycles, /* Number of complete cycles in the data */
+        nused = 0, /* Number of cycles (after merging) that can be solved */
+        first, /* First cycle after the transient */
+        all, /* Whether all of the data is used as a single cycle */
+        i, k;
+
+    /* If there isn't a single complete cycle, all of the data is used */
+    ncycles = (int) floor((val(t, n-1, 0) - t0)/period);
+    all = (ncycles < 1);
+    if(all)
+        ncycles = 1;
+    S = (double*) calloc(sizeof(double), DEMODNSUM*ncycles);
+
+    /* Project each point onto sin and cos, keeping separate sums for each
+     * cycle. Points past the last complete cycle are left out. */
+    for(i=0; i<n; i++) {
+        k = (int) floor((val(t, i, 0) - t0)/period);
+        if(all)
+            k = 0;
+        else if(k >= ncycles)
+            continue;
+        sn = sin(freq*val(t, i, 0));
+        cs = cos(freq*val(t, i, 0));
+        y = val(s, i, col);
+        S[DEMODNSUM*k+0] += sn*sn;
+        S[DEMODNSUM*k+1] += sn*cs;
+        S[DEMODNSUM*k+2] += cs*cs;
+        S[DEMODNSUM*k+3] += sn;
+        S[DEMODNSUM*k+4] += cs;
+        S[DEMODNSUM*k+5] += 1;
+        S[DEMODNSUM*k+6] += y*sn;
+        S[DEMODNSUM*k+7] += y*cs;
+        S[DEMODNSUM*k+8] += y;
+    }
+
+    /* Cycles with too few points to solve on their own (sparse sampling) are
+     * merged into the next one. Whatever is left at the end goes in with the
+     * last cycle that could be solved. */
+    for(k=0; k<ncycles; k++) {
+        for(i=0; i<DEMODNSUM; i++)
+            tot[i] += S[DEMODNSUM*k+i];
+        if(demod_solve(tot, &a, &b) == 0) {
+            memcpy(S+DEMODNSUM*nused, tot, sizeof(double)*DEMODNSUM);
+            memset(tot, 0, sizeof(double)*DEMODNSUM);
+            nused++;
+        }
+    }
+    if(nused == 0) {
+        out[0] = out[1] = out[2] = out[3] = NAN;
+        free(S);
+        return;
+    }
+    for(i=0; i<DEMODNSUM; i++)
+        S[DEMODNSUM*(nused-1)+i] += tot[i];
+
+    /* The last cycle is assumed to be at steady state. Throw out cycles from
+     * the beginning until they agree with it. */
+    demod_solve(S+DEMODNSUM*(nused-1), &a, &b);
+    for(first=0; first<nused-1; first++) {
+        demod_solve(S+DEMODNSUM*first, &ak, &bk);
+        if(hypot(ak-a, bk-b) <= DEMODTOL*hypot(a, b))
+            break;
+    }
+
+    memset(tot, 0, sizeof(double)*DEMODNSUM);
+    for(k=first; k<nused; k++)
+        for(i=0; i<DEMODNSUM; i++)
+            tot[i] += S[DEMODNSUM*k+i];
+    demod_solve(tot, &a, &b);
+
+    /* a sin(wt) + b cos(wt) = s0 sin(wt + shift) */
+    out[0] = hypot(a, b);
+    out[1] = atan2(b, a);
+    out[2] = a/e0;
+    out[3] = b/e0;
+
+    free(S);
+}
+
+/**
+ * Find the stress magnitude and phase lag of a stress signal responding to a
+ * sinusoidal strain. Instead of fitting \f$\sigma_0\sin(\omega t+\delta)\f$
+ * with nonlinear regression, the equivalent form
+ * \f$a\sin(\omega t) + b\cos(\omega t)\f$ (plus a constant offset) is
+ * linear and is solved directly from sums taken in one pass over the data.
+ * The sums are kept separately for each cycle, and cycles at the start that
+ * differ from the last one by more than DEMODTOL are treated as the initial
+ * transient and left out. Points after the last complete cycle are not used,
+ * and cycles with too few points to fit are merged with the next one.
+ * @param t Column matrix of time values [s]
+ * @param s Column matrix of stress values
+ * @param freq Angular frequency of the imposed strain [rad/s]
+ * @param e0 Strain magnitude [-]
+ * @returns A 4x1 matrix containing the stress magnitude, phase lag, storage
+ *      modulus, and loss modulus. The first two rows are the same as the ones
+ *      returned by fit_stress.
+ */
+matrix* demod_stress(matrix *t, matrix *s, double freq, double e0)
+{
+    matrix *beta;
+    double out[4];
+    int i;
+
+    demod_column(t, s, 0, freq, e0, out);
+
+    beta = CreateMatrix(4, 1);
+    for(i=0; i<4; i++)
+        setval(beta, out[i], i, 0);
+
+    return beta;
+}
+
+/**
+ * Demodulate a set of stress signals measured at different frequencies, all
+ * sampled at the same times. See demod_stress.
+ * @param t Column matrix of time values [s]
+ * @param s Matrix of stress values, with one column for each signal
+ * @param freq Array of angular frequencies, one for each column of s [rad/s]
+ * @param n Number of signals
+ * @param e0 Strain magnitude [-]
+ * @returns Matrix with one row for each signal, with the columns containing
+ *      stress magnitude, phase lag, storage modulus, and loss modulus
+ */
+matrix* demod_stress_batch(matrix *t, matrix *s, double *freq, int n,
+                           double e0)
+{
+    matrix *beta;
+    double out[4];
+    int i, j;
+
+    beta = CreateMatrix(n, 4);
+
+#pragma omp parallel for private(out, j)
+    for(i=0; i<n; i++) {
+        demod_column(t, s, i, freq[i], e0, out);
+        for(j=0; j<4; j++)
+            setval(beta, out[j], i, j);
+    }
+
+    return beta;
+}
+
 /**
  * Fit the measured stress to calculate stress magnitude and phase lag.
  * Stress-strain data is generated based on the supplied strain magnitude,
  * oscillation frequency, Maxwell parameters, temperature, and moisture content.
- * The stress magnitude and phase lag are then calculated using nonlinear
- * regression.
+ * The stress magnitude and phase lag are then found by demodulating the stress
+ * (see demod_stress).
  * @param e0 Strain magnitude [-]
  * @param freq Oscillation frequency [1/s]
  * @param m Maxwell parameters
  * @param T Temperature [K]
  * @param X Moisture content [kg/kg db]
- * @returns A 2x1 matrix. Element 1,1 is strain magnitude, and element 2,1 is
- *      phase lag.
+ * @returns A 4x1 matrix. Element 1,1 is stress magnitude, element 2,1 is
+ *      phase lag, and elements 3,1 and 4,1 are the storage and loss moduli.
  */
 matrix* fit_stress(double e0, double freq, maxwell *m, double T, double X)
 {
     int i, /* Loop index */
         npts = 1000; /* Number of points to use for fitting the data */
-    double dt = .1, /* Time step size to use when generating data */
-           s0guess = e0, /* Initial guess for the stress magnitude */
-           shiftguess = 0; /* Initial guess for phase lag */
+    double dt = .1; /* Time step size to use when generating data */
     matrix *t, /* Time matrix */
            *e, /* Strain */
-           *beta0, /* Initial guess for fitting coefficients */
            *beta, /* Fitting parameter matrix */
            *de, /* Time deriviative of strain */
            *s; /* Stress */
@@ -133,18 +338,17 @@ matrix* fit_stress(double e0, double freq, maxwell *m, double T, double X)
         setval(de, dstrain(e0, i*dt), i, 0);
     }
 
-    /* Create the initial guess matrix for the regression parameters */
-    beta0 = CreateMatrix(2, 1);
-    setval(beta0, s0guess, 0, 0);
-    setval(beta0, shiftguess, 1, 0);
-
     /* Calculate the values for stress at each point in time based on the
      * Maxwell material model */
     s = maxwell_stress(m, t, de, T, X);
 
-    /* Fit the stress to the appropriate equation to find stress magnitude and
-     * phase lag */
-    beta = fitnlm(&stress_model, t, s, beta0);
+    /* Demodulate the stress to find stress magnitude and phase lag */
+    beta = demod_stress(t, s, freq, e0);
+
+    DestroyMatrix(t);
+    DestroyMatrix(e);
+    DestroyMatrix(de);
+    DestroyMatrix(s);
 
     /* Return the results */
     return beta;
@@ -178,3 +382,55 @@ double loss_mod(double e0, double s0, double shift)
     return s0/e0 * sin(shift);
 }
 
+
+/**
+ * Fit a relaxation function to a Prony series that is accurate enough to
+ * calculate the dynamic moduli between two frequencies. Modes that relax much
+ * faster than the highest frequency or much slower than the lowest one barely
+ * contribute, so the series only needs to cover a factor of MODRANGE past
+ * either end.
+ * @param G Relaxation function (see FitProny)
+ * @param params Extra parameters for the relaxation function
+ * @param wmin Lowest angular frequency [rad/s]
+ * @param wmax Highest angular frequency [rad/s]
+ * @returns Fitted Prony series
+ */
+prony* modulus_prony(double (*G)(double, void*), void *params,
+                     double wmin, double wmax)
+{
+    return FitProny(G, params, 1/(MODRANGE*wmax), MODRANGE/wmin);
+}
+
+/**
+ * Calculate the storage modulus, loss modulus, and loss tangent directly from
+ * the Maxwell model at a set of frequencies. The relaxation function is
+ * written as a Prony series, for which the moduli are simple sums over the
+ * modes (see PronyModulus). This avoids simulating the stress response and
+ * fitting a sine wave to it for each frequency (see fit_stress).
+ * @param m Maxwell parameters
+ * @param T Temperature [K]
+ * @param X Moisture content [kg/kg db]
+ * @param freq Array of angular frequencies [rad/s]
+ * @param n Number of frequencies
+ * @param E1 Array to store the storage modulus in. May be NULL.
+ * @param E2 Array to store the loss modulus in. May be NULL.
+ * @param tand Array to store the loss tangent in. May be NULL.
+ */
+void dynamic_modulus(maxwell *m, double T, double X, double *freq, int n,
+                     double *E1, double *E2, double *tand)
+{
+    maxwellparams mp = {m, T, X};
+    double wmin = freq[0], wmax = freq[0];
+    prony *p;
+    int i;
+
+    for(i=1; i<n; i++) {
+        wmin = fmin(wmin, freq[i]);
+        wmax = fmax(wmax, freq[i]);
+    }
+
+    p = modulus_prony(&MaxwellRelaxP, &mp, wmin, wmax);
+    PronyModulus(p, freq, n, E1, E2, tand);
+    DestroyProny(p);
+}
+
@@ -3,17 +3,33 @@
 
 #include "material-data.h"
 #include "matrix.h"
+#include "hereditary.h"
+
+/**
+ * Material parameters needed to evaluate the relaxation function.
+ */
+typedef struct {
+    maxwell *m; /* Maxwell parameters */
+    double T, /* Temperature [K] */
+           M; /* Moisture content [kg/kg db] */
+} maxwellparams;
 
 double strain(double, double);
 double dstrain(double, double);
-double stress_model(double t, matrix*);
 matrix* maxwell_stress(maxwell*, matrix*, matrix*, double, double);
+matrix* demod_stress(matrix*, matrix*, double, double);
+matrix* demod_stress_batch(matrix*, matrix*, double*, int, double);
 matrix* fit_stress(double, double, maxwell*, double, double);
 double storage_mod(double, double, double);
 double loss_mod(double, double, double);
+prony* modulus_prony(double (*)(double, void*), void*, double, double);
+void dynamic_modulus(maxwell*, double, double, double*, int,
+                     double*, double*, double*);
 
 matrix* maxwell_stress_rozzi(matrix*, matrix*, double, double);
 matrix* fit_stress_rozzi(double, double, double, double);
+void dynamic_modulus_rozzi(double, double, double*, int,
+                           double*, double*, double*);
 
 #endif
 
@@ -1,67 +1,13 @@
 #include "matrix.h"
+#include "csv.h"
 #include "material-data.h"
 #include "regress.h"
+#include "pronymodel.h"
+#include "sample.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
-double PronyModel(double t, matrix* beta)
-{
-    matrix *Ji, *taui;
-    double J0, J, Jval, tauval;
-    int n, i;
-
-    /* Pull out all the parameter values */
-    J0 = val(beta, 0, 0);
-    n = (nRows(beta)-1)/2;
-    Ji = CreateMatrix(n, 1);
-    taui = CreateMatrix(n, 1);
-
-    for(i=0; i<n; i++) {
-        setval(Ji, val(beta, 2*i+1, 0), i, 0);
-        setval(taui, val(beta, 2*i+2, 0), i, 0);
-    }
-
-    J = J0;
-    for(i=0; i<n; i++) {
-        Jval = val(Ji, i, 0);
-        tauval = val(taui, i, 0);
-        J += Jval * (1-exp(-t/tauval));
-    }
-    DestroyMatrix(Ji);
-    DestroyMatrix(taui);
-    return J;
-}
-double PronyModelSqrt(double t, matrix* beta)
-{
-    matrix *Ji, *taui;
-    double J0, J, Jval, tauval;
-    int n, i;
-
-    /* Pull out all the parameter values */
-    J0 = val(beta, 0, 0);
-    n = (nRows(beta)-1)/2;
-    Ji = CreateMatrix(n, 1);
-    taui = CreateMatrix(n, 1);
-
-    for(i=0; i<n; i++) {
-        setval(Ji, val(beta, 2*i+1, 0), i, 0);
-        setval(taui, val(beta, 2*i+2, 0), i, 0);
-    }
-
-    J = J0*J0;
-    for(i=0; i<n; i++) {
-        Jval = val(Ji, i, 0);
-        Jval = Jval*Jval;
-        tauval = val(taui, i, 0);
-        tauval = tauval*tauval;
-        J += Jval * (1-exp(-t/tauval));
-    }
-    DestroyMatrix(Ji);
-    DestroyMatrix(taui);
-    return J;
-}
-
 matrix* makedata(matrix *t, double T, double M)
 {
     matrix *J;
@@ -95,7 +41,7 @@ int main(int argc, char *argv[])
     int i, j, k;
     double Ti, Mj, percent;
     vector *T, *M;
-    matrix *t, *Jij, *betaij, *output, *ttmp;
+    matrix *t, *Jij, *betaij, *output;
 
     /*
     if(argc < 3) {
@@ -113,9 +59,8 @@ int main(int argc, char *argv[])
     T = linspaceV(293, 363, 10);
     M = linspaceV(0, .5, 10);
 
-    ttmp = linspace(1, 1e3, 1000);
-    t = mtxtrn(ttmp);
-    DestroyMatrix(ttmp);
+    /* Log spacing puts the points where the creep function changes */
+    t = logspacecol(1, 1e3, 100);
 
     output = CreateMatrix(len(T)*len(M), 2+5);
 
@@ -129,7 +74,7 @@ int main(int argc, char *argv[])
             setval(output, Ti, i*len(M)+j, 0);
             setval(output, Mj, i*len(M)+j, 1);
             for(k=0; k<nRows(betaij); k++)
-                setval(output, pow(val(betaij, k, 0), 2), i*len(T)+j, k+2);
+                setval(output, pow(val(betaij, k, 0), 2), i*len(M)+j, k+2);
             DestroyMatrix(Jij);
             DestroyMatrix(betaij);
 
@@ -143,7 +88,7 @@ int main(int argc, char *argv[])
     DestroyMatrix(t);
     DestroyVector(T);
     DestroyVector(M);
-    mtxprntfilehdr(output, "output.csv", "T,M,J0,J1,tau1,J2,tau2\n");
+    csvprntfilehdr(output, "output.csv", "T,M,J0,J1,tau1,J2,tau2\n", 0);
     DestroyMatrix(output);
     return 0;
 }
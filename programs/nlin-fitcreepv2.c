@@ -1,40 +1,13 @@
 #include "matrix.h"
+#include "csv.h"
 #include "material-data.h"
 #include "regress.h"
+#include "pronymodel.h"
+#include "sample.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
-double PronyModel(double t, matrix* beta, void *params)
-{
-    matrix *Ji, *taui;
-    double *p;
-    double J0, J, Jval, tauval;
-    int n, i;
-    p = (double*) params;
-    J0 = *p;
-
-    /* Pull out all the parameter values */
-    n = nRows(beta)/2;
-    Ji = CreateMatrix(n, 1);
-    taui = CreateMatrix(n, 1);
-
-    for(i=0; i<n; i++) {
-        setval(Ji, val(beta, 2*i, 0), i, 0);
-        setval(taui, val(beta, 2*i+1, 0), i, 0);
-    }
-
-    J = J0;
-    for(i=0; i<n; i++) {
-        Jval = val(Ji, i, 0)*val(Ji, i, 0);
-        tauval = val(taui, i, 0)*val(taui, i, 0);
-        J += Jval * (1-exp(-t/tauval));
-    }
-    DestroyMatrix(Ji);
-    DestroyMatrix(taui);
-    return J;
-}
-
 matrix* makedata(matrix *t, double T, double M)
 {
     matrix *J;
@@ -65,7 +38,7 @@ matrix* fitdata(matrix *t, matrix *J)
            sqrt( .5*(Jt-J0) ),
            2, 0);
     setval(beta0, sqrt(200), 3, 0);
-    beta = fitnlmP(&PronyModel, t, J, beta0, &J0);
+    beta = fitnlmP(&PronyModelFixedJ0, t, J, beta0, &J0);
     DestroyMatrix(beta0);
     return beta;
 }
@@ -75,7 +48,7 @@ int main(int argc, char *argv[])
     int i, j, k;
     double Ti, Mj, percent;
     vector *T, *M;
-    matrix *t, *Jij, *betaij, *output, *ttmp;
+    matrix *t, *Jij, *betaij, *output;
 
     /*
     if(argc < 3) {
@@ -93,9 +66,8 @@ int main(int argc, char *argv[])
     T = linspaceV(333, 363, 10);
     M = linspaceV(.05, .4, 10);
 
-    ttmp = linspace(1e-3, 1e3, 1000);
-    t = mtxtrn(ttmp);
-    DestroyMatrix(ttmp);
+    /* Log spacing puts the points where the creep function changes */
+    t = logspacecol(1e-3, 1e3, 100);
 
     output = CreateMatrix(len(T)*len(M), 2+5);
 
@@ -110,7 +82,7 @@ int main(int argc, char *argv[])
             setval(output, Mj, i*len(M)+j, 1);
             setval(output, val(Jij, 0, 0), i*len(M)+j, 2);
             for(k=0; k<nRows(betaij); k++)
-                setval(output, pow(val(betaij, k, 0), 2), i*len(T)+j, k+3);
+                setval(output, pow(val(betaij, k, 0), 2), i*len(M)+j, k+3);
             DestroyMatrix(Jij);
             DestroyMatrix(betaij);
 
@@ -124,7 +96,7 @@ int main(int argc, char *argv[])
     DestroyMatrix(t);
     DestroyVector(T);
     DestroyVector(M);
-    mtxprntfilehdr(output, "output.csv", "T,M,J0,J1,tau1,J2,tau2\n");
+    csvprntfilehdr(output, "output.csv", "T,M,J0,J1,tau1,J2,tau2\n", 0);
     DestroyMatrix(output);
     return 0;
 }
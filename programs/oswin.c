@@ -8,6 +8,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include "matrix.h"
+#include "csv.h"
 #include "regress.h"
 
 /**
@@ -20,15 +21,15 @@
  *      is k, and element 3 is Xm.
  * @returns Moisture content [kg/kg db]
  */
-double oswin(matrix *X, matrix *beta)
+double oswin(mtxrow *X, matrix *beta)
 {
     double k0 = val(beta, 0, 0),
            k1 = val(beta, 1, 0),
            n0 = val(beta, 2, 0),
            n1 = val(beta, 3, 0),
 
-           aw = val(X, 0, 0),
-           T = val(X, 0, 1),
+           aw = rowval(X, 0),
+           T = rowval(X, 1),
     
            Xdb;
     printf("k0 = %g, k1 = %g, n0 = %g, n1 = %g, aw = %g, T = %g\n",
@@ -44,26 +45,31 @@ double oswin(matrix *X, matrix *beta)
  */
 int main(int argc, char *argv[])
 {
-    double Tcol = 1,
-           awcol = 3,
-           Xdbcol = 2;
-    matrix *data, *aw, *Xdb, *T, *beta0, *beta, *X;
+    int Tcol = 1,
+        awcol = 3,
+        Xdbcol = 2,
+        Xcols[] = {awcol, Tcol}; /* Columns for the independent variables */
+    csvtable *data;
+    matrix *Xdb, *beta0, *beta, *X;
 
     if(argc != 2) {
         puts("Usage:");
         printf("%s <aw.csv>\n", argv[0]);
         exit(0);
     }
-    //data = mtxloadcsv("Andrieu.csv", 0);
-    data = mtxloadcsv(argv[1], 1);
+    //data = CSVLoad("Andrieu.csv", 0);
+    data = CSVLoad(argv[1], 1);
+    if(!data) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        exit(1);
+    }
 
-    /* Get the water activity from column 1 and the moisture content from
-     * column 6. */
-    aw = ExtractColumn(data, awcol);
-    Xdb = ExtractColumn(data, Xdbcol);
-    T = ExtractColumn(data, Tcol);
+    /* Get the water activity and temperature as the independent variables,
+     * and the moisture content as the dependent one. */
+    X = CSVTableMatrix(data, Xcols, 2);
+    Xdb = CSVColumnMatrix(data, Xdbcol);
+    DestroyCSVTable(data);
 
-    X = AugmentMatrix(aw, T);
     mtxprnt(X);
 
     /* Use the parameters from Gina's thesis as a starting point */
@@ -0,0 +1,146 @@
+/**
+ * @file pronymodel.c
+ * Creep compliance models written as a Prony series:
+ * \f[ J(t) = J_0 + \sum_{i=1}^n J_i \left(1-\exp(-t/\tau_i)\right) \f]
+ * These are used as the model functions for fitnlm and fitnlmP, so they get
+ * called several times per data point on every iteration. Nothing here
+ * allocates memory, and series with up to PRONYMAXN modes are evaluated by
+ * versions with the sum written out for that number of modes.
+ */
+
+#include <math.h>
+#include <stddef.h>
+
+#include "pronymodel.h"
+#include "matrix.h"
+
+/* One term of the series */
+#define PRONYTERM(k) + J[k]*(1-exp(-t/tau[k]))
+
+/* Define PronySumN, which adds up the terms for exactly N modes */
+#define PRONYSUM(N, TERMS) \
+static double PronySum##N(double t, const double *J, const double *tau) \
+{ \
+    return 0 TERMS; \
+}
+
+PRONYSUM(1, PRONYTERM(0))
+PRONYSUM(2, PRONYTERM(0) PRONYTERM(1))
+PRONYSUM(3, PRONYTERM(0) PRONYTERM(1) PRONYTERM(2))
+PRONYSUM(4, PRONYTERM(0) PRONYTERM(1) PRONYTERM(2) PRONYTERM(3))
+
+/** Specialized sum for each number of modes, indexed by the number of modes */
+static double (*const PronySums[PRONYMAXN+1])(double, const double*, const double*) = {
+    NULL, PronySum1, PronySum2, PronySum3, PronySum4
+};
+
+/**
+ * Add up the terms of a Prony series with the parameters stored in a column
+ * matrix as alternating values of J and tau.
+ * @param t Time [s]
+ * @param beta Column matrix of parameters
+ * @param first Row of the first J value
+ * @param squared If nonzero, the parameters are the square roots of J and tau
+ * @returns Sum of the terms (not including J0)
+ */
+static double PronyTerms(double t, matrix *beta, int first, int squared)
+{
+    double J[PRONYMAXN], tau[PRONYMAXN], Ji, taui, sum = 0;
+    int n = (nRows(beta)-first)/2, i;
+
+    /* Too many modes for the specialized versions */
+    if(n > PRONYMAXN) {
+        for(i=0; i<n; i++) {
+            Ji = val(beta, first+2*i, 0);
+            taui = val(beta, first+2*i+1, 0);
+            if(squared) {
+                Ji = Ji*Ji;
+                taui = taui*taui;
+            }
+            sum += Ji*(1-exp(-t/taui));
+        }
+        return sum;
+    }
+    if(n < 1)
+        return 0;
+
+    for(i=0; i<n; i++) {
+        J[i] = val(beta, first+2*i, 0);
+        tau[i] = val(beta, first+2*i+1, 0);
+        if(squared) {
+            J[i] = J[i]*J[i];
+            tau[i] = tau[i]*tau[i];
+        }
+    }
+
+    return PronySums[n](t, J, tau);
+}
+
+/**
+ * Prony series creep function with the parameters in the order J0, J1, tau1,
+ * J2, tau2, and so on.
+ * @param t Time [s]
+ * @param beta Column matrix of parameters
+ * @returns Creep compliance
+ */
+double PronyModel(double t, matrix *beta)
+{
+    return val(beta, 0, 0) + PronyTerms(t, beta, 1, 0);
+}
+
+/**
+ * Prony series creep function with the parameters in the same order as
+ * PronyModel, except that each parameter is the square root of the value used.
+ * This keeps all of the values positive during fitting.
+ * @param t Time [s]
+ * @param beta Column matrix of square roots of parameters
+ * @returns Creep compliance
+ */
+double PronyModelSqrt(double t, matrix *beta)
+{
+    double J0 = val(beta, 0, 0);
+    return J0*J0 + PronyTerms(t, beta, 1, 1);
+}
+
+/**
+ * Prony series creep function with a known value of J0. The parameters are
+ * the square roots of J1, tau1, J2, tau2, and so on. This is the form used with
+ * fitnlmP.
+ * @param t Time [s]
+ * @param beta Column matrix of square roots of parameters
+ * @param params Pointer to the value of J0
+ * @returns Creep compliance
+ */
+double PronyModelFixedJ0(double t, matrix *beta, void *params)
+{
+    return *((double*) params) + PronyTerms(t, beta, 0, 1);
+}
+
+/**
+ * Evaluate a Prony series at a whole set of times.
+ * @param t Array of times [s]
+ * @param nt Number of times
+ * @param J0 Instantaneous compliance
+ * @param J Array of compliances for each mode
+ * @param tau Array of retardation times for each mode [s]
+ * @param n Number of modes
+ * @param out Array to store the creep compliance at each time in
+ */
+void PronyModelBatch(double *t, int nt, double J0, double *J, double *tau,
+                     int n, double *out)
+{
+    int i, k;
+
+    if(n >= 1 && n <= PRONYMAXN) {
+        for(i=0; i<nt; i++)
+            out[i] = J0 + PronySums[n](t[i], J, tau);
+        return;
+    }
+
+    for(i=0; i<nt; i++) {
+        out[i] = J0;
+        for(k=0; k<n; k++)
+            out[i] += J[k]*(1-exp(-t[i]/tau[k]));
+    }
+}
+
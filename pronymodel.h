@@ -0,0 +1,14 @@
+#ifndef PRONYMODEL_H
+#define PRONYMODEL_H
+
+#include "matrix.h"
+
+#define PRONYMAXN 4 /* Largest number of modes with a specialized version */
+
+double PronyModel(double, matrix*);
+double PronyModelSqrt(double, matrix*);
+double PronyModelFixedJ0(double, matrix*, void*);
+void PronyModelBatch(double*, int, double, double*, double*, int, double*);
+
+#endif
+
@@ -0,0 +1,176 @@
+/**
+ * @file proptable.c
+ * Interpolation tables for material properties. Functions like DiffCh10 are
+ * expensive to evaluate and get called once for every data point, but at a
+ * fixed temperature they are smooth functions of moisture content alone. A
+ * table only needs to be made once, and each lookup after that is just a few
+ * multiplications.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "proptable.h"
+#include "matrix.h"
+
+#define PROPTABLEINIT 17 /* Number of points to start each table with */
+#define PROPTABLEMAX 4097 /* Largest number of points allowed in a table */
+
+/**
+ * Make a table of function values that can be interpolated to within a
+ * tolerance. The table starts with PROPTABLEINIT points, and the spacing is
+ * halved until the interpolated value at every midpoint matches the actual
+ * function value, or the table has PROPTABLEMAX points. If the function is
+ * positive at every point, its log is tabulated instead, since properties
+ * like diffusivity are close to exponential in moisture content. A table that
+ * finds a value that isn't positive while it's being refined switches back
+ * to the function values themselves.
+ * @param f Function to tabulate. The second argument is passed through from
+ *      params.
+ * @param params Extra parameters for the function. These must stay around as
+ *      long as the table does, since values outside the table are calculated
+ *      directly.
+ * @param xmin First point in the table
+ * @param xmax Last point in the table
+ * @param tol Largest allowed interpolation error, relative to the function
+ *      value
+ * @returns Newly allocated table
+ */
+proptable* CreatePropTable(double (*f)(double, void*), void *params,
+                           double xmin, double xmax, double tol)
+{
+    proptable *p;
+    double *yn, /* Values after adding the midpoints */
+           xm, ym, /* Midpoint and the function value there */
+           err; /* Interpolation error at the midpoint */
+    int n = PROPTABLEINIT, /* Number of points */
+        ok, /* Whether every midpoint is within the tolerance */
+        pos, /* Whether every midpoint value is positive */
+        i;
+
+    p = (proptable*) calloc(sizeof(proptable), 1);
+    p->f = f;
+    p->params = params;
+    p->xmin = xmin;
+    p->xmax = xmax;
+
+    p->y = (double*) calloc(sizeof(double), n);
+    p->logy = 1;
+    for(i=0; i<n; i++) {
+        p->y[i] = f(xmin + (xmax-xmin)*i/(n-1), params);
+        if(!(p->y[i] > 0))
+            p->logy = 0;
+    }
+    if(p->logy)
+        for(i=0; i<n; i++)
+            p->y[i] = log(p->y[i]);
+    p->n = n;
+    p->dx = (xmax-xmin)/(n-1);
+
+    do {
+        /* Check the midpoints against the current table. The function values
+         * there are needed either way, so the table is refined even if it
+         * already meets the tolerance. */
+        yn = (double*) calloc(sizeof(double), 2*n-1);
+        ok = 1;
+        pos = 1;
+        for(i=0; i<n-1; i++) {
+            xm = xmin + (i+.5)*p->dx;
+            yn[2*i] = p->y[i];
+            ym = f(xm, params);
+            err = fabs(PropTableVal(p, xm) - ym);
+            if(!(err <= tol*fabs(ym)))
+                ok = 0;
+            if(!(ym > 0))
+                pos = 0;
+            yn[2*i+1] = ym;
+        }
+        yn[2*n-2] = p->y[n-1];
+
+        /* The log can only be kept if every new value is positive. If not,
+         * the old points go back to plain function values, and the table
+         * has to be checked again that way. */
+        if(p->logy && !pos) {
+            p->logy = 0;
+            ok = 0;
+            for(i=0; i<n; i++)
+                yn[2*i] = exp(yn[2*i]);
+        } else if(p->logy) {
+            for(i=0; i<n-1; i++)
+                yn[2*i+1] = log(yn[2*i+1]);
+        }
+
+        free(p->y);
+        p->y = yn;
+        n = 2*n-1;
+        p->n = n;
+        p->dx = (xmax-xmin)/(n-1);
+    } while(!ok && n < PROPTABLEMAX);
+
+    return p;
+}
+
+/**
+ * Free a property table.
+ * @param p Table to destroy
+ */
+void DestroyPropTable(proptable *p)
+{
+    free(p->y);
+    free(p);
+}
+
+/**
+ * Look up a value in a property table. This uses cubic interpolation between
+ * the nearest four points. Values outside the table are calculated directly
+ * from the original function.
+ * @param p Table to use
+ * @param x Value to look up
+ * @returns Function value at x
+ */
+double PropTableVal(proptable *p, double x)
+{
+    double s, /* Position relative to the first of the four points */
+           yi; /* Interpolated value */
+    double *y;
+    int i;
+
+    if(!(x >= p->xmin && x <= p->xmax))
+        return p->f(x, p->params);
+
+    s = (x - p->xmin)/p->dx;
+    i = (int) s - 1;
+    if(i < 0)
+        i = 0;
+    if(i > p->n-4)
+        i = p->n-4;
+    s -= i;
+    y = p->y + i;
+
+    /* Lagrange polynomial through points 0-3 */
+    yi = - y[0]*(s-1)*(s-2)*(s-3)/6
+         + y[1]*s*(s-2)*(s-3)/2
+         - y[2]*s*(s-1)*(s-3)/2
+         + y[3]*s*(s-1)*(s-2)/6;
+
+    return (p->logy) ? exp(yi) : yi;
+}
+
+/**
+ * Look up every element of a vector in a property table.
+ * @param p Table to use
+ * @param x Values to look up
+ * @returns Vector of function values
+ */
+vector* PropTableVector(proptable *p, vector *x)
+{
+    vector *y;
+    int i;
+
+    y = CreateVector(len(x));
+    for(i=0; i<len(x); i++)
+        setvalV(y, i, PropTableVal(p, valV(x, i)));
+
+    return y;
+}
+
@@ -0,0 +1,29 @@
+#ifndef PROPTABLE_H
+#define PROPTABLE_H
+
+#include "matrix.h"
+
+/**
+ * Table of values of a function of one variable at evenly spaced points,
+ * used in place of expensive material property functions.
+ * @see CreatePropTable
+ */
+typedef struct {
+    double (*f)(double, void*); /* Function the table was made from */
+    void *params; /* Extra parameters for the function */
+    double xmin, /* First point in the table */
+           xmax, /* Last point in the table */
+           dx; /* Spacing between points */
+    int n, /* Number of points */
+        logy; /* Set if the table stores the log of the function values */
+    double *y; /* Function values (or their logs) at each point */
+} proptable;
+
+proptable* CreatePropTable(double (*)(double, void*), void*,
+                           double, double, double);
+void DestroyPropTable(proptable*);
+double PropTableVal(proptable*, double);
+vector* PropTableVector(proptable*, vector*);
+
+#endif
+
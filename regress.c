@@ -122,3 +122,24 @@ double rsquared(matrix* x, matrix* y, matrix *beta)
     return 1-SSres/SStot;
 }
 
+/**
+ * Copy every stride-th row of a matrix, starting with the first. For data
+ * sorted by x, this is a stratified sample: one point from each run of stride
+ * rows, so the whole range is still covered.
+ * @param m Matrix to sample
+ * @param stride Number of rows between samples
+ * @returns New matrix
+ * @see fitnlm
+ */
+matrix* StrideRows(matrix *m, int stride)
+{
+    matrix *s;
+    int i, j;
+
+    s = CreateMatrix((nRows(m) + stride-1)/stride, nCols(m));
+    for(i=0; i<nRows(s); i++)
+        for(j=0; j<nCols(m); j++)
+            setval(s, val(m, i*stride, j), i, j);
+
+    return s;
+}
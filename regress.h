@@ -3,11 +3,31 @@
 
 #include "matrix.h"
 
+/* Coarse-to-fine fitting (see fitnlm). Fits with at least
+ * FITCOARSEMIN*FITCOARSEGROW rows start on a subsample. */
+#define FITCOARSEMIN 2048 /* Fewest rows in the first subsample */
+#define FITCOARSEGROW 4 /* Factor the subsample grows by on each pass */
+#define FITCOARSEITER 50 /* Most iterations on each subsample */
+
+/**
+ * Non-owning view of a single row of a matrix. This is what fitnlmM passes to
+ * the model function for each data point, so that rows don't need to be
+ * copied out of the data matrix.
+ */
+typedef struct {
+    matrix *m; /* Matrix the row belongs to */
+    int row; /* Row index */
+} mtxrow;
+
+/** Value in column j of a row view */
+#define rowval(r, j) val((r)->m, (r)->row, (j))
+
 matrix* regress(matrix*, matrix*);
 matrix* polyfit(matrix*, matrix*, int);
 matrix* fitnlm(double (*)(double, matrix*), matrix*, matrix*, matrix*);
-matrix* fitnlmM(double (*)(matrix *, matrix*), matrix*, matrix*, matrix*);
+matrix* fitnlmM(double (*)(mtxrow*, matrix*), matrix*, matrix*, matrix*);
 matrix* fitnlmP(double (*)(double, matrix*, void*), matrix*, matrix*, matrix*, void*);
 double rsquared(matrix*, matrix*, matrix*);
+matrix* StrideRows(matrix*, int);
 
 #endif
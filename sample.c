@@ -0,0 +1,311 @@
+/**
+ * @file sample.c
+ * Choose the points to sample a function at when generating data to fit.
+ * Functions like creep compliance change quickly at short times and level off
+ * at long times, so evenly spaced points mostly end up on the plateau. The
+ * same goes for measured data, which can be thinned out before fitting.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "sample.h"
+#include "matrix.h"
+
+#define SAMPLEINIT 9 /* Number of points to start adaptive sampling with */
+
+/**
+ * Make a column matrix of logarithmically spaced values.
+ * @param a First value (must be positive)
+ * @param b Last value
+ * @param n Number of values
+ * @returns Column matrix of values
+ */
+matrix* logspacecol(double a, double b, int n)
+{
+    matrix *x;
+    int i;
+
+    x = CreateMatrix(n, 1);
+    for(i=0; i<n; i++)
+        setval(x, (n > 1) ? a*pow(b/a, (double) i/(n-1)) : a, i, 0);
+
+    return x;
+}
+
+/**
+ * Choose points to sample a function at so that linear interpolation (in log
+ * time) between them is accurate to within a tolerance. This starts with
+ * SAMPLEINIT logarithmically spaced points and repeatedly splits each interval
+ * where the function value at the midpoint differs from the interpolated value
+ * by more than the tolerance. The interpolation error is proportional to the
+ * curvature, so points end up concentrated where the function bends the
+ * most. Intervals that pass the check are never checked again, so each pass
+ * only evaluates the function at the midpoints of intervals that were just
+ * split. (The range of the function values only grows as points are added, so
+ * an interval that passes once would pass again.)
+ * @param f Function to sample. The first argument is time, and the second is
+ *      passed through from params.
+ * @param params Extra parameters for the function
+ * @param a First time (must be positive)
+ * @param b Last time
+ * @param tol Largest allowed interpolation error, relative to the range of
+ *      the function values
+ * @param nmax Largest number of points to use
+ * @returns Column matrix of times, in increasing order
+ */
+matrix* AdaptiveSample(double (*f)(double, void*), void *params,
+                       double a, double b, double tol, int nmax)
+{
+    double *x, *y, /* Log of time and function values at each point */
+           *xn, *yn, /* Values after splitting intervals */
+           *tmp,
+           ymin, ymax, xm, ym;
+    char *active, /* Whether each interval still needs to be checked */
+         *activen, /* Flags after splitting intervals */
+         *ctmp;
+    int n = SAMPLEINIT, /* Number of points */
+        nn, /* Number of points after splitting */
+        split = 1, /* Whether any intervals were split on the last pass */
+        i;
+    matrix *t;
+
+    if(nmax < 2)
+        nmax = 2;
+    if(n > nmax)
+        n = nmax;
+
+    x = (double*) calloc(sizeof(double), nmax);
+    y = (double*) calloc(sizeof(double), nmax);
+    xn = (double*) calloc(sizeof(double), nmax);
+    yn = (double*) calloc(sizeof(double), nmax);
+    active = (char*) calloc(sizeof(char), nmax);
+    activen = (char*) calloc(sizeof(char), nmax);
+
+    for(i=0; i<n; i++) {
+        x[i] = log(a) + (log(b) - log(a))*i/(n-1);
+        y[i] = f(exp(x[i]), params);
+        active[i] = 1;
+    }
+
+    while(split && n < nmax) {
+        ymin = ymax = y[0];
+        for(i=1; i<n; i++) {
+            ymin = fmin(ymin, y[i]);
+            ymax = fmax(ymax, y[i]);
+        }
+
+        split = 0;
+        nn = 0;
+        for(i=0; i<n; i++) {
+            xn[nn] = x[i];
+            yn[nn] = y[i];
+            activen[nn++] = active[i];
+            if(i == n-1 || !active[i] || nn + (n-1-i) >= nmax)
+                continue;
+
+            xm = .5*(x[i] + x[i+1]);
+            ym = f(exp(xm), params);
+            if(fabs(ym - .5*(y[i] + y[i+1])) > tol*(ymax - ymin)) {
+                xn[nn] = xm;
+                yn[nn] = ym;
+                activen[nn++] = 1;
+                split = 1;
+            } else {
+                activen[nn-1] = 0;
+            }
+        }
+
+        tmp = x; x = xn; xn = tmp;
+        tmp = y; y = yn; yn = tmp;
+        ctmp = active; active = activen; activen = ctmp;
+        n = nn;
+    }
+
+    t = CreateMatrix(n, 1);
+    for(i=0; i<n; i++)
+        setval(t, exp(x[i]), i, 0);
+
+    free(x);
+    free(y);
+    free(xn);
+    free(yn);
+    free(active);
+    free(activen);
+
+    return t;
+}
+
+/**
+ * Deviation of a point from the line between two others.
+ */
+static double LineDeviation(vector *x, vector *y, int a, int b, int i)
+{
+    double dx = valV(x, b) - valV(x, a);
+
+    if(dx == 0)
+        return fabs(valV(y, i) - valV(y, a));
+    return fabs(valV(y, i) - valV(y, a)
+                - (valV(y, b) - valV(y, a))*(valV(x, i) - valV(x, a))/dx);
+}
+
+/**
+ * Pick the fewest points of a curve needed to reproduce it to within a
+ * tolerance by linear interpolation (Douglas-Peucker). Starting with the
+ * first and last points, the point farthest from the line between each pair
+ * of neighboring kept points is added until every point is within the
+ * tolerance. Distance is measured in y, so the tolerance is in the same units
+ * as the data. Long stretches where the curve barely changes end up as a
+ * single segment.
+ * @param x Independent variable (such as time), in increasing order
+ * @param y Dependent variable
+ * @param tol Largest allowed interpolation error
+ * @param keep Array of flags with one element for each point. Points that are
+ *      already set are always kept, and every point chosen is set.
+ * @returns Number of points kept
+ */
+int DecimateCurve(vector *x, vector *y, double tol, char *keep)
+{
+    int *stack, /* Pairs of points left to check */
+        n = 0, /* Size of the stack */
+        nkeep = 0, /* Number of points kept */
+        a, b, i, imax;
+    double d, dmax;
+
+    if(len(x) < 1)
+        return 0;
+    keep[0] = keep[len(x)-1] = 1;
+
+    /* Start with every segment between the points already kept */
+    stack = (int*) calloc(sizeof(int), 2*len(x));
+    for(a=0, b=1; b<len(x); b++) {
+        if(!keep[b])
+            continue;
+        stack[n++] = a;
+        stack[n++] = b;
+        a = b;
+    }
+
+    while(n > 0) {
+        b = stack[--n];
+        a = stack[--n];
+
+        dmax = 0;
+        imax = -1;
+        for(i=a+1; i<b; i++) {
+            d = LineDeviation(x, y, a, b, i);
+            if(d > dmax) {
+                dmax = d;
+                imax = i;
+            }
+        }
+
+        /* Split the segment at the worst point */
+        if(imax > 0 && dmax > tol) {
+            keep[imax] = 1;
+            stack[n++] = a;
+            stack[n++] = imax;
+            stack[n++] = imax;
+            stack[n++] = b;
+        }
+    }
+    free(stack);
+
+    for(i=0; i<len(x); i++)
+        nkeep += keep[i] ? 1 : 0;
+
+    return nkeep;
+}
+
+/**
+ * Copy the kept elements of a vector into a new one.
+ * @param v Vector to copy from
+ * @param keep Flags set by DecimateCurve
+ * @param n Number of flags that are set
+ * @returns New vector with n elements
+ */
+vector* DecimateVector(vector *v, char *keep, int n)
+{
+    vector *d;
+    int i, j = 0;
+
+    d = CreateVector(n);
+    for(i=0; i<len(v) && j<n; i++)
+        if(keep[i])
+            setvalV(d, j++, valV(v, i));
+
+    return d;
+}
+
+/**
+ * Expand a decimated curve back out to the original points by linear
+ * interpolation. Points outside the decimated curve get the value at the
+ * nearest end, and so do points next to a value that isn't finite (such as a
+ * NaN in the first row).
+ * @param xd Independent variable of the decimated curve, in increasing order
+ * @param yd Dependent variable of the decimated curve
+ * @param x Points to interpolate at, in increasing order
+ * @returns Vector of interpolated values, one for each element of x
+ */
+vector* ExpandVector(vector *xd, vector *yd, vector *x)
+{
+    vector *y;
+    int i, j = 0;
+    double dx, a, b;
+
+    y = CreateVector(len(x));
+    for(i=0; i<len(x); i++) {
+        while(j < len(xd)-2 && valV(xd, j+1) < valV(x, i))
+            j++;
+        if(len(xd) < 2 || valV(x, i) <= valV(xd, 0)) {
+            setvalV(y, i, valV(yd, 0));
+        } else if(valV(x, i) >= valV(xd, len(xd)-1)) {
+            setvalV(y, i, valV(yd, len(xd)-1));
+        } else {
+            dx = valV(xd, j+1) - valV(xd, j);
+            a = valV(yd, j);
+            b = valV(yd, j+1);
+            if(isfinite(a) && isfinite(b) && dx)
+                setvalV(y, i, a + (b - a)*(valV(x, i) - valV(xd, j))/dx);
+            else
+                setvalV(y, i, (valV(x, i) - valV(xd, j) < .5*dx) ? a : b);
+        }
+    }
+
+    return y;
+}
+
+/**
+ * Number of original points each kept point stands for, so that sums over
+ * the decimated data can be weighted to match sums over all of the original
+ * points. Each point gets half of the gap to the points on either side of it,
+ * and the weights add up to the original number of points.
+ * @param keep Flags set by DecimateCurve
+ * @param npts Number of original points
+ * @param n Number of flags that are set
+ * @returns Vector of weights with n elements
+ */
+vector* DecimateWeights(char *keep, int npts, int n)
+{
+    vector *w;
+    int i, j = 0,
+        prev = -1, /* Original index of the previous kept point */
+        cur = -1; /* Original index of the current kept point */
+
+    w = CreateVector(n);
+    for(i=0; i<npts; i++) {
+        if(!keep[i])
+            continue;
+        if(cur >= 0) {
+            setvalV(w, j++, .5*(i - prev));
+            prev = cur;
+        } else {
+            prev = i-1;
+        }
+        cur = i;
+    }
+    if(cur >= 0)
+        setvalV(w, j, .5*(cur+1 - prev));
+
+    return w;
+}
@@ -0,0 +1,15 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "matrix.h"
+
+matrix* logspacecol(double, double, int);
+matrix* AdaptiveSample(double (*)(double, void*), void*,
+                       double, double, double, int);
+int DecimateCurve(vector*, vector*, double, char*);
+vector* DecimateVector(vector*, char*, int);
+vector* ExpandVector(vector*, vector*, vector*);
+vector* DecimateWeights(char*, int, int);
+
+#endif
+
@@ -0,0 +1,48 @@
+/**
+ * @file slidekf.c
+ * Check slidekf with a one point window. The window at t = 0 has no
+ * information about kF and should come back as NaN, while every other window
+ * should give a finite, positive kF.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "programs/kF/kf.h"
+
+int main(int argc, char *argv[])
+{
+    int n = 50, /* Number of data points */
+        i, /* Loop index */
+        fail = 0; /* Set if any of the checks fail */
+    double kf = 2e-4, /* kF used to generate the data [1/s] */
+           X0 = .4, /* Initial moisture content [kg/kg db] */
+           Xe = .08; /* Equilibrium moisture content [kg/kg db] */
+    vector *t, *X, *kF;
+
+    t = CreateVector(n);
+    X = CreateVector(n);
+    for(i=0; i<n; i++) {
+        setvalV(t, i, 30.0*i);
+        setvalV(X, i, CrankEquation(kf, valV(t, i), X0, Xe, CONSTnterms));
+    }
+
+    kF = slidekf(t, X, Xe, 1, 1);
+
+    if(!isnan(valV(kF, 0))) {
+        fprintf(stderr, "slidekf: row 0 gave %g instead of NaN\n", valV(kF, 0));
+        fail = 1;
+    }
+    for(i=1; i<n; i++) {
+        if(!isfinite(valV(kF, i)) || valV(kF, i) <= 0) {
+            fprintf(stderr, "slidekf: row %d gave %g\n", i, valV(kF, i));
+            fail = 1;
+        }
+    }
+
+    DestroyVector(t);
+    DestroyVector(X);
+    DestroyVector(kF);
+
+    return fail;
+}